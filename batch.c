@@ -0,0 +1,322 @@
+/* batch.c -- running one edlin script over many files
+
+  DESCRIPTION:
+
+  This file contains edlin's batch mode.  The list of files is built
+  first, then worker processes are forked, each of which reopens the
+  script for itself and takes the next file off the list by bumping a
+  counter they share, until the list runs out.  What happened to each
+  file goes into a table they share as well, which is printed once all
+  the workers have finished.  A worker that dies leaves its file marked
+  as failed.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+/* includes */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>             /* need fork, dup */
+#endif
+#ifdef HAVE_IO_H
+#include <io.h>                 /* need dup */
+#endif
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_STDATOMIC_H
+#include <stdatomic.h>
+#endif
+#ifdef HAVE_GLOB_H
+#include <glob.h>
+#endif
+#include "batch.h"
+#include "dynstr.h"
+#include "fileio.h"
+#include "json.h"
+#include "msgs.h"
+#include "pool.h"
+
+/* macros */
+
+#if defined(HAVE_FORK) && defined(HAVE_SYS_WAIT_H) \
+    && defined(HAVE_SYS_MMAN_H) && defined(HAVE_STDATOMIC_H)
+#define BATCH_FORK
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#endif
+
+#if defined(HAVE_UNISTD_H) || defined(HAVE_IO_H)
+#define RESTORE_STDOUT                /* stdout can be put back */
+#endif
+
+/* where the output of the script goes */
+#if defined(__MSDOS__) || defined(_WIN32)
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+
+/* typedefs */
+
+#ifdef BATCH_FORK
+/* what the workers share */
+typedef struct SHARED
+{
+  atomic_ulong next;            /* the next file to take */
+  char status[1];               /* what happened to each file */
+} SHARED;
+#endif
+
+/* functions */
+
+/* add_name - add name to the list of files */
+static void
+add_name (DAS_ARRAY_T * names, char *name)
+{
+  static STRING_T empty;
+
+  DAS_append (names, &empty, 1, 1);
+  DSassigncstr (DAS_get_at (names, DAS_length (names) - 1), name, NPOS);
+}
+
+/* add_pattern - add the files name matches, or name itself if it has
+   no wildcards (or the system cannot expand them) */
+static void
+add_pattern (DAS_ARRAY_T * names, char *name)
+{
+#ifdef HAVE_GLOB_H
+  glob_t g;
+  size_t i;
+
+  if (strpbrk (name, "*?[") != 0 && glob (name, 0, 0, &g) == 0)
+    {
+      for (i = 0; i < g.gl_pathc; ++i)
+	add_name (names, g.gl_pathv[i]);
+      globfree (&g);
+      return;
+    }
+#endif
+  add_name (names, name);
+}
+
+/* add_list - add the files named in the file list, one per line */
+static void
+add_list (DAS_ARRAY_T * names, char *list)
+{
+  DAS_ARRAY_T *lines;
+  FILE *f = strcmp (list, "-") == 0 ? stdin : fopen (list, "r");
+  size_t i;
+
+  if (f == 0)
+    {
+      if (json_output)
+	json_record ("error", "cannot_open", list);
+      else
+	fprintf (stderr, G00048, list);
+      return;
+    }
+  lines = DAS_create ();
+  fio_load (f, ZIO_PLAIN, lines, 0);
+  for (i = 0; i < DAS_length (lines); ++i)
+    if (DSlength (DAS_get_at (lines, i)) != 0)
+      add_name (names, DScstr (DAS_get_at (lines, i)));
+  DAS_destroy (lines);
+  if (f != stdin)
+    fclose (f);
+}
+
+/* batch_add - add the files name stands for to the list */
+void
+batch_add (DAS_ARRAY_T * names, char *name)
+{
+  if (name[0] == '@')
+    add_list (names, name + 1);
+  else
+    add_pattern (names, name);
+}
+
+/* edit - run fn over the file on the script, which is on stdin */
+static int
+edit (batch_fn * fn, char *filename)
+{
+  rewind (stdin);
+  return fn (filename);
+}
+
+#ifdef BATCH_FORK
+/* run_workers - do the files in worker processes; returns zero if none
+   could be started */
+static int
+run_workers (char *script, DAS_ARRAY_T * names, batch_fn * fn,
+	     char *status)
+{
+  unsigned long n = DAS_length (names), i;
+  unsigned k, workers = pool_size (), started = 0;
+  size_t size = sizeof (SHARED) + n;
+  SHARED *sh;
+
+  if (workers > n)
+    workers = (unsigned) n;
+  if (workers < 2)
+    return 0;
+  sh = mmap (0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+	     -1, 0);
+  if (sh == MAP_FAILED)
+    return 0;
+  atomic_init (&sh->next, 0);
+  memset (sh->status, BATCH_FAILED, n);
+  fflush (stdout);
+  fflush (stderr);
+  for (k = 0; k < workers; ++k)
+    switch (fork ())
+      {
+      case 0:
+	/* a worker: its files are its only work, so one thread will do */
+	pool_limit (1);
+	if (freopen (script, "r", stdin) != 0
+	    && freopen (NULL_DEVICE, "w", stdout) != 0)
+	  while ((i = atomic_fetch_add (&sh->next, 1)) < n)
+	    sh->status[i] = (char) edit (fn, DScstr (DAS_get_at (names, i)));
+	fflush (stdout);
+	_exit (0);
+      case -1:
+	break;
+      default:
+	started++;
+	break;
+      }
+  if (started == 0)
+    {
+      munmap ((void *) sh, size);
+      return 0;
+    }
+  while (started > 0 && wait (0) > 0)
+    started--;
+  memcpy (status, sh->status, n);
+  munmap ((void *) sh, size);
+  return 1;
+}
+#endif
+
+/* run_serial - do the files one after another in this process */
+static void
+run_serial (char *script, DAS_ARRAY_T * names, batch_fn * fn,
+	    char *status)
+{
+  unsigned long i;
+#ifdef RESTORE_STDOUT
+  int out;
+
+  fflush (stdout);
+  if ((out = dup (fileno (stdout))) >= 0
+      && freopen (NULL_DEVICE, "w", stdout) == 0)
+    {
+      close (out);
+      out = -1;
+    }
+#endif
+  if (freopen (script, "r", stdin) == 0)
+    memset (status, BATCH_FAILED, DAS_length (names));
+  else
+    for (i = 0; i < DAS_length (names); ++i)
+      status[i] = (char) edit (fn, DScstr (DAS_get_at (names, i)));
+#ifdef RESTORE_STDOUT
+  fflush (stdout);
+  if (out >= 0)
+    {
+      dup2 (out, fileno (stdout));
+      close (out);
+      clearerr (stdout);
+    }
+#endif
+}
+
+/* batch_run - run fn over the files */
+unsigned long
+batch_run (char *script, int nfiles, char **files, batch_fn * fn)
+{
+  DAS_ARRAY_T *names = DAS_create ();
+  unsigned long count[3], n, i;
+  char *status;
+  STRING_T *ds;
+  FILE *f;
+  int k;
+
+  for (k = 0; k < nfiles; ++k)
+    batch_add (names, files[k]);
+  n = DAS_length (names);
+  if ((f = fopen (script, "r")) == 0)
+    {
+      if (json_output)
+	json_record ("error", "cannot_open", script);
+      else
+	fprintf (stderr, G00048, script);
+      DAS_destroy (names);
+      return n != 0 ? n : 1;
+    }
+  fclose (f);
+  if ((status = malloc (n + 1)) == 0)
+    Nomemory ();
+#ifdef BATCH_FORK
+  if (!run_workers (script, names, fn, status))
+#endif
+    run_serial (script, names, fn, status);
+  count[BATCH_UNCHANGED] = count[BATCH_WRITTEN] = count[BATCH_FAILED] = 0;
+  for (i = 0; i < n; ++i)
+    {
+      k = status[i] == BATCH_WRITTEN || status[i] == BATCH_UNCHANGED
+	? status[i] : BATCH_FAILED;
+      count[k]++;
+      if (json_output)
+	json_record (k == BATCH_WRITTEN ? "written" : k == BATCH_UNCHANGED
+		     ? "unchanged" : "failed", 0,
+		     DScstr (DAS_get_at (names, i)));
+      else
+	printf (k == BATCH_WRITTEN ? G00049 : k == BATCH_UNCHANGED ? G00050
+		: G00051, DScstr (DAS_get_at (names, i)));
+    }
+  if (json_output)
+    {
+      /* the tally */
+      ds = DScreate ();
+      json_begin (ds, "batch");
+      json_number (ds, "files", n);
+      json_number (ds, "written", count[BATCH_WRITTEN]);
+      json_number (ds, "unchanged", count[BATCH_UNCHANGED]);
+      json_number (ds, "failed", count[BATCH_FAILED]);
+      json_end (ds);
+      fputs (DScstr (ds), stdout);
+      DSdestroy (ds);
+    }
+  else
+    printf (G00052, n, count[BATCH_WRITTEN], count[BATCH_UNCHANGED],
+	    count[BATCH_FAILED]);
+  free (status);
+  DAS_destroy (names);
+  return count[BATCH_FAILED];
+}
+
+/* END OF FILE */
@@ -0,0 +1,62 @@
+/* batch.h -- running one edlin script over many files
+
+  DESCRIPTION:
+
+  This file contains the interface to edlin's batch mode, which applies
+  the same script of commands to every file in a list.  Where the system
+  can fork, one worker process per processor takes files off the list
+  until it is empty; each worker has an editor of its own, and edlin
+  only starts up once.  Elsewhere, the files are done one at a time.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "dynstr.h"
+
+/* macros */
+
+/* what happened to a file */
+#define BATCH_UNCHANGED 0
+#define BATCH_WRITTEN   1
+#define BATCH_FAILED    2
+
+/* typedefs */
+
+/* Edit filename with the commands read from the standard input, which
+   is at the start of the script; returns what happened to it.  */
+typedef int batch_fn (char *filename);
+
+/* functions */
+
+/* add the files name stands for to names.  A name may hold wildcards,
+   and "@list" stands for the names in the file list, one per line ("@-"
+   reads them from the standard input).  */
+void batch_add (DAS_ARRAY_T * names, char *name);
+
+/* run fn over the nfiles files named in files (see batch_add), with
+   the script on the standard input.  The output of the script is thrown
+   away; what happened to each file is printed instead.  Returns how
+   many files failed.  */
+unsigned long batch_run (char *script, int nfiles, char **files,
+                         batch_fn * fn);
+
+#endif
+
+/* END OF FILE */
@@ -0,0 +1,226 @@
+/* cancel.c -- stopping long commands, and saying how far they have got
+
+  DESCRIPTION:
+
+  This file contains the interrupt handling of edlin.  The signal
+  handler does nothing but set a flag, which is all that can safely be
+  done there; the commands poll the flag between pieces of their work,
+  from whichever threads are doing it.
+
+  Progress is reported from whichever thread happens to get there
+  first; a flag that only one thread at a time can hold keeps the
+  others from waiting on it, so reporting never holds the work up.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+/* includes */
+
+#include "config.h"
+#include <signal.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#ifdef HAVE_STDATOMIC_H
+#include <stdatomic.h>
+#endif
+#include "cancel.h"
+#include "dynstr.h"
+#include "json.h"
+#include "msgs.h"
+
+/* macros */
+
+/* Only one thread at a time reports progress; the others go on with
+   their work rather than wait for it.  */
+#ifdef HAVE_STDATOMIC_H
+#define TRY_LOCK()      (!atomic_flag_test_and_set (&busy))
+#define UNLOCK()        atomic_flag_clear (&busy)
+#else
+#define TRY_LOCK()      (busy ? 0 : (busy = 1))
+#define UNLOCK()        (busy = 0)
+#endif
+
+/* static variables */
+
+#ifdef HAVE_STDATOMIC_H
+static atomic_int interrupted = 0;
+static atomic_flag busy = ATOMIC_FLAG_INIT;
+#else
+static volatile sig_atomic_t interrupted = 0;
+static int busy = 0;
+#endif
+
+static int enabled = 0;
+
+/* the command being reported on */
+static struct
+{
+  int active, unit;
+  unsigned long first, last;
+  unsigned long at;		/* the furthest it has got */
+  time_t start, shown;
+  size_t width;			/* how much of the line is written on */
+} progress;
+
+/* functions */
+
+/* on_interrupt - the SIGINT handler */
+static void
+on_interrupt (int sig)
+{
+  interrupted = 1;
+#ifdef HAVE_SIGACTION
+  (void) sig;
+#else
+  /* some systems put the default action back first */
+  signal (sig, on_interrupt);
+#endif
+}
+
+/* catch interrupts from now on */
+void
+cancel_init (void)
+{
+#ifdef HAVE_SIGACTION
+  struct sigaction sa;
+
+  memset (&sa, 0, sizeof sa);
+  sa.sa_handler = on_interrupt;
+  sigemptyset (&sa.sa_mask);
+#ifdef SA_RESTART
+  sa.sa_flags = SA_RESTART;     /* the prompt goes on reading */
+#endif
+  sigaction (SIGINT, &sa, 0);
+#else
+  signal (SIGINT, on_interrupt);
+#endif
+  enabled = 1;
+}
+
+/* has there been an interrupt? */
+int
+cancelled (void)
+{
+  return interrupted != 0;
+}
+
+/* forget about it */
+void
+cancel_clear (void)
+{
+  interrupted = 0;
+}
+
+/* show - write out how far the command has got */
+static void
+show (time_t now)
+{
+  static STRING_T *out = 0;
+  char line[128];
+  unsigned long done = progress.at - progress.first;
+  unsigned long total = progress.last - progress.first;
+  unsigned long secs = (unsigned long) difftime (now, progress.start);
+  unsigned long rate = done / (secs != 0 ? secs : 1), left = 0;
+  char *unit = progress.unit == PROGRESS_BYTES ? G00062 : G00061;
+  size_t n;
+
+  if (progress.last > progress.first && rate != 0)
+    left = (total - done) / rate;
+  if (json_output)
+    {
+      if (out == 0)
+	out = DScreate ();
+      json_begin (out, "progress");
+      json_string (out, "unit", progress.unit == PROGRESS_BYTES
+		   ? "bytes" : "lines", NPOS);
+      json_number (out, "done", done);
+      if (progress.last > progress.first)
+	{
+	  json_number (out, "total", total);
+	  json_number (out, "left", left);
+	}
+      json_number (out, "rate", rate);
+      json_end (out);
+      fputs (DScstr (out), stderr);
+      return;
+    }
+  if (progress.last > progress.first)
+    sprintf (line, G00059, (unsigned long) ((double) done * 100 / total),
+	     total, unit, rate, unit, left / 60, left % 60);
+  else
+    sprintf (line, G00060, done, unit, rate, unit);
+  n = strlen (line);
+  fprintf (stderr, "\r%s%*s", line,
+	   (int) (progress.width > n ? progress.width - n : 0), "");
+  fflush (stderr);
+  progress.width = n;
+}
+
+/* a command is starting */
+void
+progress_start (int unit, unsigned long first, unsigned long last)
+{
+  while (!TRY_LOCK ())
+    ;
+  progress.active = enabled;
+  progress.unit = unit;
+  progress.first = progress.at = first;
+  progress.last = last;
+  progress.start = progress.shown = time (0);
+  progress.width = 0;
+  UNLOCK ();
+}
+
+/* the command has got as far as at */
+void
+progress_at (unsigned long at)
+{
+  time_t now;
+
+  if (!TRY_LOCK ())
+    return;
+  if (progress.active)
+    {
+      if (at > progress.at)
+	progress.at = at;
+      now = time (0);
+      if (now != progress.shown && difftime (now, progress.start) >= 1)
+	{
+	  show (now);
+	  progress.shown = now;
+	}
+    }
+  UNLOCK ();
+}
+
+/* the command is over */
+void
+progress_end (void)
+{
+  while (!TRY_LOCK ())
+    ;
+  if (progress.active && progress.width != 0)
+    {
+      fprintf (stderr, "\r%*s\r", (int) progress.width, "");
+      fflush (stderr);
+    }
+  progress.active = 0;
+  UNLOCK ();
+}
+
+/* END OF FILE */
@@ -0,0 +1,69 @@
+/* cancel.h -- stopping long commands, and saying how far they have got
+
+  DESCRIPTION:
+
+  This file contains the interface to the interrupt handling of edlin.
+  Once cancel_init has been called, an interrupt (Ctrl-C) no longer
+  ends edlin; it only sets a flag, which the commands that can take a
+  long time (searching, replacing, loading and saving) look at between
+  pieces of their work.  A command that finds the flag set stops where
+  it is, with every line of the buffer either done or not done, and
+  says it was interrupted.  The flag is cleared before each command.
+
+  The same commands report how far they have got on the standard error,
+  at most once a second, from the time they have run for a second.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+#ifndef CANCEL_H
+#define CANCEL_H
+
+/* macros */
+
+/* what progress is counted in */
+#define PROGRESS_LINES  0
+#define PROGRESS_BYTES  1
+
+/* functions */
+
+/* catch interrupts from now on, and report progress */
+void cancel_init (void);
+
+/* has there been an interrupt since cancel_clear was last called?  Any
+   thread may ask. */
+int cancelled (void);
+
+/* forget about any interrupt so far */
+void cancel_clear (void);
+
+/* a command is about to work through the units from first up to (but
+   not including) last; if last is not past first, how many there are is
+   not known */
+void progress_start (int unit, unsigned long first, unsigned long last);
+
+/* the command has got as far as at; any thread may say so, and what is
+   reported is the furthest any of them has got */
+void progress_at (unsigned long at);
+
+/* the command is over; the progress report, if there is one, is
+   wiped out */
+void progress_end (void);
+
+#endif
+
+/* END OF FILE */
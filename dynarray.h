@@ -16,6 +16,11 @@
             steps beyond just using operator=.)
   Tstorage_class - Use to change the storage class to "static" in case we want
                    all the functions to be static.
+  Trelocatable - Define this if an instance of type T can be moved to another
+                 address with memcpy() and a constructed instance owns nothing
+                 (as with a string that owns its own buffer).  Growing,
+                 inserting and removing then move elements instead of
+                 assigning them one by one.
 
   The following macros must be predefined:
 
@@ -47,6 +52,7 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
 #include "defines.h"
 
 #define _NM(y,x)                _VAL(y,x)
@@ -79,8 +85,10 @@
 #define _TS_reserve             _NM(TS, _reserve)
 #define _TS_resize              _NM(TS, _resize)
 #define _TS_set_reserve         _NM(TS, _set_reserve)
+#define _TS_splice              _NM(TS, _splice)
 #define _TS_subarray            _NM(TS, _subarray)
 #define _TS_swap                _NM(TS, _swap)
+#define _TS_transfer            _NM(TS, _transfer)
 
 #undef  T_STORAGE_CLASS_DEFINED
 #ifndef Tstorage_class
@@ -119,9 +127,12 @@ Tstorage_class _TS_ARRAY_T *_TS_remove (_TS_ARRAY_T *, size_t, size_t);
 Tstorage_class size_t _TS_reserve (_TS_ARRAY_T *);
 Tstorage_class void _TS_resize (_TS_ARRAY_T *, size_t, T *);
 Tstorage_class void _TS_set_reserve (_TS_ARRAY_T *, size_t);
+Tstorage_class _TS_ARRAY_T *_TS_splice (_TS_ARRAY_T *, size_t, _TS_ARRAY_T *);
 Tstorage_class _TS_ARRAY_T *_TS_subarray (_TS_ARRAY_T *, _TS_ARRAY_T *,
                                           size_t, size_t);
 Tstorage_class void _TS_swap (_TS_ARRAY_T *, _TS_ARRAY_T *);
+Tstorage_class _TS_ARRAY_T *_TS_transfer (_TS_ARRAY_T *, _TS_ARRAY_T *,
+                                          size_t, size_t);
 
 #else
 #ifndef Tctor
@@ -192,6 +203,9 @@ _TS_Grow (_TS_ARRAY_T * this, size_t n, T * s, int trim)
   else
     {
       m = this->_Ptr == 0 && n < this->_Res ? this->_Res : n;
+      if (!trim && m < os + (os >> 1))
+        m = os + (os >> 1);     /* grow by half again, so appending one
+                                   element at a time is not quadratic */
       np = calloc (m, sizeof (T));
       if (np == 0)
         Nomemory ();            /* no memory */
@@ -199,12 +213,24 @@ _TS_Grow (_TS_ARRAY_T * this, size_t n, T * s, int trim)
         Tctor (np + i);
       r = m;
       m = n < this->_Len ? n : this->_Len;
+#ifdef Trelocatable
+      if (m != 0)
+        memcpy (np, this->_Ptr, m * sizeof (T));
+      for (i = m; i < this->_Len; ++i)
+        Tdtor (this->_Ptr + i);
+      i = m;
+#else
       for (i = 0; i < m; ++i)
         Tassign (np + i, this->_Ptr + i);
+#endif
       if (s != 0)
         for (; i < this->_Res; ++i)
           Tassign (np + i, s);
+#ifdef Trelocatable
+      free (this->_Ptr);
+#else
       _TS_Tidy (this, 1);
+#endif
       this->_Ptr = np;
       this->_Res = r;
     }
@@ -362,11 +388,18 @@ _TS_insert (_TS_ARRAY_T * this, size_t p, T * s, size_t n, size_t d)
   if (0 < n)
     {
       i = this->_Len - p;
+#ifdef Trelocatable
+      _TS_Grow (this, n + this->_Len, 0, 0);
+      memmove (this->_Ptr + (p + n), this->_Ptr + p, i * sizeof (T));
+      for (i = 0; i < n; ++i)
+        Tctor (this->_Ptr + (p + i));
+#else
       for (_TS_Grow (this, n + this->_Len, 0, 0); 0 < i;)
         {
           --i;
           Tassign (this->_Ptr + (p + n + i), this->_Ptr + (p + i));
         }
+#endif
       for (i = 0; i < n; ++i, s += d)
         Tassign (this->_Ptr + (p + i), s);
     }
@@ -386,13 +419,52 @@ _TS_remove (_TS_ARRAY_T * this, size_t p, size_t n)
   if (0 < n)
     {
       m = this->_Len - p - n;
+#ifdef Trelocatable
+      for (i = 0; i < n; ++i)
+        Tdtor (this->_Ptr + (p + i));
+      memmove (this->_Ptr + p, this->_Ptr + (p + n), m * sizeof (T));
+      for (i = 0; i < n; ++i)
+        Tctor (this->_Ptr + (p + m + i));
+#else
       for (i = 0; i < m; ++i)
         Tassign (this->_Ptr + (p + i), this->_Ptr + (p + i + n));
+#endif
       _TS_Grow (this, this->_Len - n, 0, 0);
     }
   return this;
 }
 
+/* _splice: Move all the elements of x into this at position p, leaving x
+   empty.  */
+Tstorage_class _TS_ARRAY_T *
+_TS_splice (_TS_ARRAY_T * this, size_t p, _TS_ARRAY_T * x)
+{
+#ifdef Trelocatable
+  size_t i, n = x->_Len;
+
+  if (this->_Len < p)
+    _TS_Xran ();
+  if (NPOS - this->_Len <= n)
+    _TS_Xlen ();
+  if (this->_Len == 0)
+    _TS_swap (this, x);
+  else if (0 < n)
+    {
+      i = this->_Len - p;
+      _TS_Grow (this, n + this->_Len, 0, 0);
+      memmove (this->_Ptr + (p + n), this->_Ptr + p, i * sizeof (T));
+      memcpy (this->_Ptr + p, x->_Ptr, n * sizeof (T));
+      for (i = 0; i < n; ++i)
+        Tctor (x->_Ptr + i);
+    }
+  _TS_Tidy (x, 1);
+#else
+  _TS_insert (this, p, x->_Ptr, x->_Len, 1);
+  _TS_Tidy (x, 1);
+#endif
+  return this;
+}
+
 /* _subarray: Assign the n elements starting at this[p] to x.  It's okay
    if this and x are the same array.  */
 Tstorage_class _TS_ARRAY_T *
@@ -425,6 +497,38 @@ _TS_swap (_TS_ARRAY_T * this, _TS_ARRAY_T * x)
   x->_Res = t;
 }
 
+/* _transfer: Move the n elements starting at x[p] onto the end of this,
+   leaving freshly constructed elements in their place in x.  This and x
+   must be different arrays.  */
+Tstorage_class _TS_ARRAY_T *
+_TS_transfer (_TS_ARRAY_T * this, _TS_ARRAY_T * x, size_t p, size_t n)
+{
+#ifdef Trelocatable
+  size_t i, m = this->_Len;
+#endif
+
+  if (this == x)
+    _TS_Xinv ();
+  if (x->_Len < p)
+    _TS_Xran ();
+  if (x->_Len - p < n)
+    n = x->_Len - p;
+  if (NPOS - this->_Len <= n)
+    _TS_Xlen ();
+#ifdef Trelocatable
+  if (0 < n)
+    {
+      _TS_Grow (this, m + n, 0, 0);
+      memcpy (this->_Ptr + m, x->_Ptr + p, n * sizeof (T));
+      for (i = 0; i < n; ++i)
+        Tctor (x->_Ptr + (p + i));
+    }
+  return this;
+#else
+  return _TS_append (this, x->_Ptr + p, n, 1);
+#endif
+}
+
 /* _get_at: Return the element at this[i].  */
 Tstorage_class T *
 _TS_get_at (_TS_ARRAY_T * this, size_t i)
@@ -517,8 +621,10 @@ _TS_set_reserve (_TS_ARRAY_T * this, size_t r)
 #undef _TS_reserve
 #undef _TS_resize
 #undef _TS_set_reserve
+#undef _TS_splice
 #undef _TS_subarray
 #undef _TS_swap
+#undef _TS_transfer
 
 #ifdef T_STORAGE_CLASS_DEFINED
 #undef T_STORAGE_CLASS_DEFINED
@@ -39,6 +39,9 @@
 #ifdef HAVE_STRINGS_H
 #include <strings.h>
 #endif
+#ifdef HAVE_STDATOMIC_H
+#include <stdatomic.h>
+#endif
 #include "defines.h"
 #include "dynstr.h"
 #include "msgs.h"
@@ -47,8 +50,29 @@
 
 #define MIN_SIZE 31
 
+/* Segments are this big, and start on a multiple of their size, so that
+   the segment a string's characters are in can be found from where
+   they are.  */
+#define SEG_SIZE        ((size_t) 1 << 18)
+#define SEG_OF(p)       ((DSSEG *) ((size_t) (p) & ~(SEG_SIZE - 1)))
+
+/* A string whose characters are in a segment has no reserve of its own;
+   every other string that has characters has some.  */
+#define IN_SEG(s)       ((s)->ptr != 0 && (s)->res == 0)
+
 /* typedefs */
 
+/* The head of a segment, which the characters follow.  */
+struct DSSEG
+{
+#ifdef HAVE_STDATOMIC_H
+  atomic_size_t users;          /* strings in it, and whoever fills it */
+#else
+  size_t users;
+#endif
+  size_t used;                  /* how much of it is taken, head and all */
+};
+
 /* functions */
 
 /* This file needs memchr(), memmove(), and memset().  If these functions are
@@ -317,6 +341,18 @@ memset (void *s, int c, size_t n)
 
 #endif /* HAVE_MEMSET */
 
+/* DSseg_release: One user fewer for seg; the last one frees it.  */
+static void
+DSseg_release (DSSEG * seg)
+{
+#ifdef HAVE_STDATOMIC_H
+  if (atomic_fetch_sub (&seg->users, 1) == 1)
+#else
+  if (--seg->users == 0)
+#endif
+    free (seg);
+}
+
 /* DStidy: Tidy up the fields in the STRING_T.
    This function is called right after a string is allocated and
    also right before it is freed to initialize the contents to 0.
@@ -324,7 +360,9 @@ memset (void *s, int c, size_t n)
 static void
 DStidy (STRING_T * this, int constructed)
 {
-  if (constructed && this->ptr)
+  if (constructed && IN_SEG (this))
+    DSseg_release (SEG_OF (this->ptr));
+  else if (constructed && this->ptr)
     free (this->ptr);
   this->ptr = 0;
   this->len = 0;
@@ -334,11 +372,12 @@ DStidy (STRING_T * this, int constructed)
 /* DSgrow: Adjusts the allocated memory inside this->ptr to n if
    n is bigger than the amount that has already been allocated
    (in this->res).  If trim is true, do a reallocation even if
-   n is less than the original size.  */
+   n is less than the original size.  A string in a segment can shrink
+   where it is, but has to move out to grow.  */
 static int
 DSgrow (STRING_T * this, size_t n, int trim)
 {
-  size_t osize = this->ptr == 0 ? 0 : this->res;
+  size_t osize = this->ptr == 0 ? 0 : IN_SEG (this) ? this->len : this->res;
   size_t size;
   char *s;
 
@@ -350,15 +389,23 @@ DSgrow (STRING_T * this, size_t n, int trim)
 	this->ptr[this->len = 0] = '\0';
       return 0;
     }
-  else if (n == osize || (n < osize && !trim))
+  else if (n == osize || (n < osize && (!trim || IN_SEG (this))))
     return 1;
   else
     {
       size = this->ptr == 0 && n < this->res ? this->res : n;
       if ((size |= MIN_SIZE) == NPOS)
 	--size;
-      if ((s = (char *) realloc (this->ptr, size + 1)) == 0
-	  && (s = (char *) realloc (this->ptr, (size = n) + 1)) == 0)
+      if (IN_SEG (this))
+	{
+	  if ((s = (char *) malloc (size + 1)) == 0
+	      && (s = (char *) malloc ((size = n) + 1)) == 0)
+	    Nomemory ();
+	  memcpy (s, this->ptr, this->len + 1);
+	  DSseg_release (SEG_OF (this->ptr));
+	}
+      else if ((s = (char *) realloc (this->ptr, size + 1)) == 0
+	       && (s = (char *) realloc (this->ptr, (size = n) + 1)) == 0)
 	Nomemory ();
       this->ptr = s;
       this->res = size;
@@ -1006,6 +1053,63 @@ DSset_reserve (STRING_T * this, size_t n)
     this->res = n;
 }
 
+/* DSseg_create: Start a segment, or return a null pointer if there is
+   no memory for one or no way to line it up.  */
+DSSEG *
+DSseg_create (void)
+{
+#ifdef HAVE_POSIX_MEMALIGN
+  void *p;
+  DSSEG *seg;
+
+  if (posix_memalign (&p, SEG_SIZE, SEG_SIZE) != 0)
+    return 0;
+  seg = p;
+#ifdef HAVE_STDATOMIC_H
+  atomic_init (&seg->users, 1);
+#else
+  seg->users = 1;
+#endif
+  seg->used = sizeof (DSSEG);
+  return seg;
+#else
+  return 0;
+#endif
+}
+
+/* DSassign_seg: Make this the n characters at s, kept in seg after the
+   ones already there.  Returns zero, leaving this alone, if they do not
+   fit.  */
+int
+DSassign_seg (STRING_T * this, DSSEG * seg, char *s, size_t n)
+{
+  char *t;
+
+  if (SEG_SIZE - seg->used <= n)
+    return 0;
+  t = (char *) seg + seg->used;
+  memcpy (t, s, n);
+  t[n] = '\0';
+  seg->used += n + 1;
+#ifdef HAVE_STDATOMIC_H
+  atomic_fetch_add (&seg->users, 1);
+#else
+  seg->users++;
+#endif
+  DStidy (this, 1);
+  this->ptr = t;
+  this->len = n;
+  return 1;
+}
+
+/* DSseg_close: Put no more strings in seg; it goes once they do.  */
+void
+DSseg_close (DSSEG * seg)
+{
+  if (seg != 0)
+    DSseg_release (seg);
+}
+
 /* DSsubstr: Create a string equal to the substring of this at position p
    with length n.  */
 STRING_T *
@@ -1023,6 +1127,7 @@ DSsubstr (STRING_T * this, size_t p, size_t n)
 #define Tassign(x,y)    DSassign(x,y,0,NPOS)
 #define Tctor(x)        DSctor(x)
 #define Tdtor(x)        DSdtor(x)
+#define Trelocatable
 #undef  Tstorage_class
 #undef  PROTOS_ONLY
 #include "dynarray.h"
@@ -1031,5 +1136,6 @@ DSsubstr (STRING_T * this, size_t p, size_t n)
 #undef  Tassign
 #undef  Tctor
 #undef  Tdtor
+#undef  Trelocatable
 
 /* END OF FILE */
@@ -37,6 +37,13 @@ typedef struct STRING_T
   size_t len, res;
 } STRING_T;
 
+/* Many strings can keep their characters one after another in a
+   segment, instead of each in memory of its own, so that going through
+   them goes straight through memory.  They act like any other string;
+   one that has to grow moves out of the segment, and a segment is given
+   back once it is closed and no string is left in it.  */
+typedef struct DSSEG DSSEG;
+
 /* exported functions */
 
 void DSctor (STRING_T * this);
@@ -82,12 +89,24 @@ void DSresize (STRING_T * this, size_t n, int c);
 size_t DSreserve (STRING_T * this);
 void DSset_reserve (STRING_T * this, size_t n);
 STRING_T *DSsubstr (STRING_T * this, size_t p, size_t n);
+DSSEG *DSseg_create (void);
+int DSassign_seg (STRING_T * this, DSSEG * seg, char *s, size_t n);
+void DSseg_close (DSSEG * seg);
+
+/* start bringing the characters of this into the cache, where the
+   compiler can be asked to */
+#ifdef HAVE___BUILTIN_PREFETCH
+#define DSprefetch(this)        __builtin_prefetch ((this)->ptr)
+#else
+#define DSprefetch(this)
+#endif
 
 #define T               STRING_T
 #define TS              DAS
 #define Tassign(x,y)    DSassign(x,y,0,NPOS)
 #define Tctor(x)        DSctor(x)
 #define Tdtor(x)        DSdtor(x)
+#define Trelocatable
 #undef  Tstorage_class
 #define PROTOS_ONLY
 #include "dynarray.h"
@@ -96,6 +115,7 @@ STRING_T *DSsubstr (STRING_T * this, size_t p, size_t n);
 #undef  Tassign
 #undef  Tctor
 #undef  Tdtor
+#undef  Trelocatable
 #undef  PROTOS_ONLY
 
 #endif
@@ -30,6 +30,7 @@
 
 #include "config.h"
 #include <ctype.h>
+#include <limits.h>
 #ifdef HAVE_MEMORY_H
 #include <memory.h>
 #endif
@@ -45,6 +46,15 @@
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>		/* need access */
 #endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_STDATOMIC_H
+#include <stdatomic.h>
+#endif
 #if defined(_MSC_VER) || defined(HAVE_IO_H)
 #include <io.h>			/* need access */
 #ifdef _MSC_VER
@@ -58,8 +68,18 @@
 #define HAVE_UNLINK
 #endif
 #endif
+#include "batch.h"
+#include "cancel.h"
 #include "dynstr.h"
+#include "edlib.h"
+#include "fileio.h"
+#include "find.h"
+#include "fuzzy.h"
+#include "json.h"
+#include "lineedit.h"
 #include "msgs.h"
+#include "norm.h"
+#include "pool.h"
 
 /* typedefs */
 
@@ -72,10 +92,188 @@
 #define rename(x, y) (link(x,y)?(-1):(unlink(x)))
 #endif
 #define FILENAME_DELIMITERS     ":/\\"
+#if defined(HAVE_PREAD) && defined(HAVE_UNISTD_H)
+#define KEEP_ORIGIN		/* keep the original file open for saves */
+#endif
+
+/* Runs of unchanged lines shorter than this are written out like any
+   others rather than copied from the original file.  */
+#define COPY_MIN		16384
+
+/* A session file starts with SESSION_MAGIC and then the header words
+   below, each SESSION_WORD bytes with the least significant first; a
+   word of all ones stands for nothing.  The name of the file being
+   edited follows, padded to a whole word, then three words for each run
+   of lines: how many there are, where they start, and how many bytes
+   they take up in the original file (without the last newline), or
+   nothing if they are in the payload instead.  The payload comes last,
+   each line being a word holding its length and then the line.  */
+#define SESSION_MAGIC		"EDLNSES1"
+#define SESSION_WORD		8
+#define SESSION_LINES		0
+#define SESSION_RUNS		1
+#define SESSION_CURRENT		2
+#define SESSION_CHANGED		3
+#define SESSION_SIZE		4	/* of the original file */
+#define SESSION_MTIME		5	/* and when it was last changed */
+#define SESSION_NAME		6	/* how long its name is */
+#define SESSION_MARKS		7
+#define SESSION_WORDS		(SESSION_MARKS + MARKS)
+#define SESSION_HEAD		(SESSION_WORD * (1 + SESSION_WORDS))
+#define SESSION_RUN		(SESSION_WORD * 3)
+#define SESSION_NONE		((off_t) -1)
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_SYS_STAT_H)
+#define SESSION_MMAP		/* session and original files are mapped */
+#endif
+
+/* The lines of the buffer are taken in blocks of this many for the
+   summaries below.  */
+#define BLOCK_LINES		1024
+
+/* what is known about a block */
+#define BLOCK_UNKNOWN		0
+#define BLOCK_MISSED		1	/* a search has gone through it */
+#define BLOCK_SUMMED		2	/* it has a summary */
+
+#define LONG_BITS		(CHAR_BIT * sizeof (unsigned long))
+#define PAIR_BITS		4096
+#define PAIR_HASH(a, b)		((((unsigned) (a) << 4) ^ (b)) & (PAIR_BITS - 1))
+
+/* Which bytes turn up in a block of lines, and which pairs of bytes
+   (hashed) turn up next to each other in one of its lines.  A string
+   with a byte or a pair that is not there cannot be in the block.  */
+typedef struct SUMMARY
+{
+  unsigned long bytes[(UCHAR_MAX + 1) / LONG_BITS];
+  unsigned long pairs[PAIR_BITS / LONG_BITS];
+} SUMMARY;
+
+/* a file read in whole, by mapping it if that can be done */
+typedef struct WHOLE
+{
+  char *p;
+  size_t len;
+  int mapped;
+} WHOLE;
+
+/* a flag that tells a search running on another thread to give up */
+#ifdef HAVE_STDATOMIC_H
+typedef atomic_int STOP_T;
+#else
+typedef volatile int STOP_T;
+#endif
+
+/* what find_line looks for */
+typedef struct FIND
+{
+  STRING_T *ds;
+  FUZZY *fuzzy;			/* or a null pointer for ds itself */
+  SUMMARY *need;		/* what ds holds, or a null pointer */
+  STOP_T *stop;			/* or a null pointer */
+  int report;			/* say how far the search has got */
+} FIND;
+
+/* While the user is asked whether a line found by ?s or ?r is the one,
+   the search for the next line goes ahead on a helper task.  */
+typedef struct SPEC
+{
+  POOL_TASK *task;		/* null when nothing is running */
+  int state;			/* SPEC_IDLE, SPEC_RUNNING or SPEC_DONE */
+  FIND find;
+  STOP_T stop;
+  FUZZY *fuzzy;			/* what is being looked for, if not ds */
+  SUMMARY *need;		/* what ds holds, if blocks may be skipped */
+  int report;			/* the search is the progress to report */
+  unsigned long first, last;	/* the lines being searched */
+  unsigned long found;		/* what was found */
+} SPEC;
+
+#define SPEC_IDLE	0
+#define SPEC_RUNNING	1
+#define SPEC_DONE	2
+
+/* While edits are deferred, the buffer is left alone and the lines it
+   is to hold are described by a list of pieces, each a run of lines of
+   the buffer or of the lines inserted since.  */
+typedef struct PIECE
+{
+  int added;			/* the lines are in added, not buffer */
+  size_t from, n;
+} PIECE;
+
+/* Invoke "dynarray.h" to get us arrays of pieces. */
+#define T               PIECE
+#define TS              PIECE
+#define PROTOS_ONLY
+#include "dynarray.h"
+#define Tassign(x,y)    (*(x) = *(y))
+#define Tctor(x)        ((x)->added = 0, (x)->from = (x)->n = 0)
+#define Tdtor(x)
+#define Trelocatable
+#undef  Tstorage_class
+#undef  PROTOS_ONLY
+#include "dynarray.h"
+#undef  T
+#undef  TS
+#undef  Tassign
+#undef  Tctor
+#undef  Tdtor
+#undef  Trelocatable
+
 /* static variables */
 
 DAS_ARRAY_T *buffer = 0;
 
+/* Where each line of the buffer sits in the original file, which is
+   kept open on origin_fd.  */
+static ORG_ARRAY_T *origin = 0;
+static int origin_fd = -1;
+static off_t nowhere = FIO_NOWHERE;
+
+/* Has the buffer changed since it was loaded or saved?  */
+static int changed = 0;
+
+/* How many times the buffer has been changed or replaced; what is
+   worked out from the lines holds as long as this stays the same.  */
+static unsigned long generation = 0;
+
+/* The addresses /text/ and ?text? worked out lately.  */
+typedef struct ADDR
+{
+  STRING_T *text;		/* null if the slot is unused */
+  int backward;
+  size_t from;			/* the first line looked at */
+  size_t found;			/* the line found, or NPOS */
+  unsigned long generation;
+} ADDR;
+
+#define ADDR_CACHE	8
+static ADDR addr_cache[ADDR_CACHE];
+static int addr_next = 0;
+
+/* Are edits to be deferred?  If they have been, pieces is the list of
+   pieces, added holds the lines inserted, and pending is how many lines
+   there are to be; otherwise pieces is a null pointer.  */
+static int defer = 0;
+static PIECE_ARRAY_T *pieces = 0;
+static DAS_ARRAY_T *added = 0;
+static size_t pending = 0;
+
+/* What is known about each whole block of lines in the buffer, and the
+   summaries of the blocks that have them.  A block is only summed up
+   the second time a search goes through it without finding anything,
+   so a buffer that is searched once pays nothing; a change to a line
+   adds what it holds to its block's summary, and a line inserted or
+   deleted makes everything known about the blocks after it unknown.  */
+static unsigned char *block_state = 0;
+static SUMMARY *summaries = 0;
+static size_t blocks = 0;
+
+/* The line each mark is on, or NPOS.  There are so few marks that the
+   edits below can simply go through all of them.  */
+static size_t marks[MARKS];
+
 /* functions */
 
 #ifndef __STDC__
@@ -221,7 +419,366 @@ file_exists (char *filename)
 #endif
 }
 
-/* make_bakfile - make a backup file */
+/* The edit funnel.  Every change to the lines of the buffer goes
+   through these, so that what is kept alongside each line stays in
+   step with it.  */
+
+/* mark_shift - make room in the marks for n lines inserted before
+   line */
+static void
+mark_shift (size_t line, size_t n)
+{
+  int i;
+
+  for (i = 0; i < MARKS; ++i)
+    if (marks[i] != NPOS && marks[i] >= line)
+      marks[i] += n;
+}
+
+/* mark_remove - drop the marks on the n lines starting at line, and
+   move the ones after them up */
+static void
+mark_remove (size_t line, size_t n)
+{
+  int i;
+
+  for (i = 0; i < MARKS; ++i)
+    if (marks[i] == NPOS || marks[i] < line)
+      continue;
+    else if (marks[i] < line + n)
+      marks[i] = NPOS;
+    else
+      marks[i] -= n;
+}
+
+/* piece_split - make a piece of the deferred edits start at line, and
+   return which one it is */
+static size_t
+piece_split (size_t line)
+{
+  size_t i, at = 0;
+  PIECE *p, q;
+
+  if (pieces == 0)
+    {
+      /* start with the whole buffer */
+      pieces = PIECE_create ();
+      added = DAS_create ();
+      q.added = 0;
+      q.from = 0;
+      q.n = pending = DAS_length (buffer);
+      if (q.n != 0)
+	PIECE_append (pieces, &q, 1, 1);
+    }
+  for (i = 0; i < PIECE_length (pieces) && at < line; ++i)
+    {
+      p = PIECE_get_at (pieces, i);
+      if (line < at + p->n)
+	{
+	  q = *p;
+	  q.from += line - at;
+	  q.n -= line - at;
+	  p->n = line - at;
+	  PIECE_insert (pieces, i + 1, &q, 1, 1);
+	  return i + 1;
+	}
+      at += p->n;
+    }
+  return i;
+}
+
+/* defer_insert - note that n new lines from s go before line */
+static void
+defer_insert (size_t line, STRING_T * s, size_t n)
+{
+  size_t i = piece_split (line);
+  PIECE *p = i > 0 ? PIECE_get_at (pieces, i - 1) : 0, q;
+
+  if (p != 0 && p->added && p->from + p->n == DAS_length (added))
+    p->n += n;			/* the next line of an insert */
+  else
+    {
+      q.added = 1;
+      q.from = DAS_length (added);
+      q.n = n;
+      PIECE_insert (pieces, i, &q, 1, 1);
+    }
+  DAS_append (added, s, n, 1);
+  pending += n;
+}
+
+/* defer_remove - note that the n lines starting at line are to go */
+static void
+defer_remove (size_t line, size_t n)
+{
+  size_t i = piece_split (line);
+
+  if (n > pending - line)
+    n = pending - line;
+  PIECE_remove (pieces, i, piece_split (line + n) - i);
+  pending -= n;
+}
+
+/* defer_move - note that the n lines starting at line are to go before
+   line3 */
+static void
+defer_move (size_t line, size_t n, size_t line3)
+{
+  PIECE_ARRAY_T *moved = PIECE_create ();
+  size_t i = piece_split (line), j = piece_split (line + n);
+
+  PIECE_subarray (pieces, moved, i, j - i);
+  PIECE_remove (pieces, i, j - i);
+  PIECE_splice (pieces, piece_split (line3 >= line + n ? line3 - n : line3),
+		moved);
+  PIECE_destroy (moved);
+}
+
+/* blocks_forget - forget what is known about the blocks from the one
+   line is in on */
+static void
+blocks_forget (size_t line)
+{
+  size_t b = line / BLOCK_LINES;
+
+  if (b < blocks)
+    memset (block_state + b, BLOCK_UNKNOWN, blocks - b);
+}
+
+/* summary_add - add what the n characters at s hold to sum */
+static void
+summary_add (SUMMARY * sum, const char *s, size_t n)
+{
+  const unsigned char *t = (const unsigned char *) s, *end = t + n;
+  unsigned h, prev;
+
+  if (t == end)
+    return;
+  prev = *t++;
+  sum->bytes[prev / LONG_BITS] |= 1UL << (prev % LONG_BITS);
+  for (; t < end; prev = *t++)
+    {
+      h = PAIR_HASH (prev, *t);
+      sum->bytes[*t / LONG_BITS] |= 1UL << (*t % LONG_BITS);
+      sum->pairs[h / LONG_BITS] |= 1UL << (h % LONG_BITS);
+    }
+}
+
+/* edit_insert - insert n lines from s before line; org says where they
+   sit in the original file, or is a null pointer if they are new */
+static void
+edit_insert (size_t line, STRING_T * s, off_t * org, size_t n)
+{
+  if (defer && org == 0)
+    defer_insert (line, s, n);
+  else
+    {
+      commit_edits ();
+      blocks_forget (line);
+      DAS_insert (buffer, line, s, n, 1);
+      if (org != 0)
+	ORG_insert (origin, line, org, n, 1);
+      else
+	ORG_insert (origin, line, &nowhere, n, 0);
+    }
+  changed = 1;
+  generation++;
+  mark_shift (line, n);
+}
+
+/* edit_splice - move all of lines (and org) in before line */
+static void
+edit_splice (size_t line, DAS_ARRAY_T * lines, ORG_ARRAY_T * org)
+{
+  size_t n = DAS_length (lines);
+
+  commit_edits ();
+  blocks_forget (line);
+  DAS_splice (buffer, line, lines);
+  changed = 1;
+  generation++;
+  mark_shift (line, n);
+  if (org != 0)
+    ORG_splice (origin, line, org);
+  else
+    ORG_insert (origin, line, &nowhere, n, 0);
+}
+
+/* edit_remove - remove n lines starting at line */
+static void
+edit_remove (size_t line, size_t n)
+{
+  if (defer && line <= get_last_line ())
+    defer_remove (line, n);
+  else
+    {
+      commit_edits ();
+      blocks_forget (line);
+      DAS_remove (buffer, line, n);
+      ORG_remove (origin, line, n);
+    }
+  changed = 1;
+  generation++;
+  mark_remove (line, n);
+}
+
+/* edit_move - move the n lines starting at line, which are also in s
+   (and org) unless edits are deferred, to before line3, taking their
+   marks with them */
+static void
+edit_move (size_t line, size_t n, size_t line3, STRING_T * s, off_t * org)
+{
+  size_t moved[MARKS], to = line3 >= line + n ? line3 - n : line3;
+  int i;
+
+  for (i = 0; i < MARKS; ++i)
+    moved[i] = marks[i] != NPOS && marks[i] >= line && marks[i] < line + n
+      ? marks[i] - line : NPOS;
+  if (defer)
+    {
+      defer_move (line, n, line3);
+      changed = 1;
+      generation++;
+      if (line3 >= line + n)
+	{
+	  mark_shift (line3, n);
+	  mark_remove (line, n);
+	}
+      else
+	{
+	  mark_remove (line, n);
+	  mark_shift (line3, n);
+	}
+    }
+  else if (line3 >= line + n)
+    {
+      edit_insert (line3, s, org, n);
+      edit_remove (line, n);
+    }
+  else
+    {
+      edit_remove (line, n);
+      edit_insert (line3, s, org, n);
+    }
+  for (i = 0; i < MARKS; ++i)
+    if (moved[i] != NPOS)
+      marks[i] = to + moved[i];
+}
+
+/* edit_put - replace line with s */
+static void
+edit_put (size_t line, STRING_T * s)
+{
+  size_t b = line / BLOCK_LINES;
+
+  commit_edits ();
+  if (b < blocks && block_state[b] == BLOCK_SUMMED)
+    summary_add (summaries + b, DScstr (s), DSlength (s));
+  DAS_put_at (buffer, line, s);
+  ORG_put_at (origin, line, &nowhere);
+  changed = 1;
+  generation++;
+}
+
+/* edit_changed - line has been changed where it stands.  Unlike the
+   other edits this may run on several threads at once, as long as no two
+   of them touch the same block of lines; the caller commits any deferred
+   edits first and sees to changed and generation afterwards.  */
+static void
+edit_changed (size_t line)
+{
+  size_t b = line / BLOCK_LINES;
+  STRING_T *s = DAS_get_at (buffer, line);
+
+  if (b < blocks && block_state[b] == BLOCK_SUMMED)
+    summary_add (summaries + b, DScstr (s), DSlength (s));
+  ORG_put_at (origin, line, &nowhere);
+}
+
+/* origin_close - forget the original file */
+static void
+origin_close (void)
+{
+#ifdef KEEP_ORIGIN
+  if (origin_fd >= 0)
+    close (origin_fd);
+#endif
+  origin_fd = -1;
+}
+
+/* unchanged_run - how many lines from line on (but before last) still
+   follow one another in the original file as they did; *bytes gets how
+   much of the file they take up */
+static size_t
+unchanged_run (size_t line, size_t last, off_t * bytes)
+{
+  off_t at = *ORG_get_at (origin, line), end = at;
+  size_t i;
+
+  *bytes = 0;
+  if (origin_fd < 0 || at == FIO_NOWHERE)
+    return 0;
+  for (i = line; i < last && *ORG_get_at (origin, i) == end; ++i)
+    end += DSlength (DAS_get_at (buffer, i)) + 1;
+  *bytes = end - at;
+  return i - line;
+}
+
+/* origin_rebase - the whole buffer has just been written to filename,
+   so that becomes the original file */
+static void
+origin_rebase (char *filename)
+{
+#ifdef KEEP_ORIGIN
+  FILE *f;
+  size_t i;
+  off_t at = 0;
+
+  if ((f = fopen (filename, "r")) == 0)
+    return;
+  origin_close ();
+  origin_fd = dup (fileno (f));
+  fclose (f);
+  for (i = 0; i < DAS_length (buffer); ++i)
+    {
+      ORG_put_at (origin, i, &at);
+      at += DSlength (DAS_get_at (buffer, i)) + 1;
+    }
+#endif
+}
+
+/* origin_move - the original file has just been copied to bakname,
+   which will now stand in for it if filename is about to be rewritten */
+static void
+origin_move (char *filename, char *bakname)
+{
+#ifdef KEEP_ORIGIN
+  FILE *f;
+
+  if (!fio_same_file (origin_fd, filename))
+    return;
+  origin_close ();
+  if ((f = fopen (bakname, "r")) == 0)
+    return;
+  origin_fd = dup (fileno (f));
+  fclose (f);
+#endif
+}
+
+/* origin_overwrite - filename is about to be truncated, so if it is the
+   original file, lines can no longer be copied out of it */
+static void
+origin_overwrite (char *filename)
+{
+  if (fio_same_file (origin_fd, filename))
+    origin_close ();
+}
+
+/* make_bakfile - make a backup file.  If the file can be copied without
+   going through edlin, it is, and the file is then rewritten in place;
+   otherwise it is renamed and written anew.  If that fails too, there is
+   no backup, and the file will be rewritten in place with nothing copied
+   out of it.  */
 static void
 make_bakfile (char *filename)
 {
@@ -239,81 +796,654 @@ make_bakfile (char *filename)
   if (dotpos != NPOS)
     DSresize (s, dotpos, 0);
   DSappendcstr (s, bak, NPOS);
-  rename (filename, DScstr (s));
+  if (fio_backup (filename, DScstr (s)) == 0)
+    origin_move (filename, DScstr (s));
+  else if (rename (filename, DScstr (s)) != 0)
+    origin_overwrite (filename);
   DSdestroy (s);
 }
 
 /* commands */
 
-/* read_from_file - read a line from a file */
+/* report_lines - say how many lines were read from or written to a
+   file, using one or many as the message */
+static void
+report_lines (char *type, char *filename, unsigned long n, char *one,
+	      char *many)
+{
+  static STRING_T *out = 0;
+
+  if (!json_output)
+    {
+      printf (n == 1 ? one : many, filename, n);
+      return;
+    }
+  if (out == 0)
+    out = DScreate ();
+  json_begin (out, type);
+  json_string (out, "file", filename, NPOS);
+  json_number (out, "lines", n);
+  json_end (out);
+  fwrite (DScstr (out), 1, DSlength (out), stdout);
+}
+
+/* write_failed - say that writing to filename went wrong */
+static void
+write_failed (char *filename)
+{
+  if (json_output)
+    json_record ("error", "write_failed", filename);
+  else
+    printf (G00051, filename);
+}
+
+/* line_record - make a JSON record of the type given for line, whose
+   text is s */
 static STRING_T *
-read_from_file (FILE * f, STRING_T * s)
+line_record (char *type, unsigned long line, STRING_T * s, int current)
 {
-  char buffer[BUFSIZ];
+  static STRING_T *out = 0;
+
+  if (out == 0)
+    out = DScreate ();
+  json_begin (out, type);
+  json_number (out, "line", line + 1);
+  if (current)
+    json_flag (out, "current", 1);
+  json_string (out, "text", DScstr (s), DSlength (s));
+  json_end (out);
+  return out;
+}
 
-  if (s == 0)
-    s = DScreate ();
-  DSresize (s, 0, 0);
-  while (fgets (buffer, BUFSIZ, f) != 0)
+/* merge_file - read a file into the buffer before line; if original is
+   nonzero, it is the file being edited and is kept open for saves */
+static void
+merge_file (unsigned long line, char *filename, int original)
+{
+  DAS_ARRAY_T *lines;
+  ORG_ARRAY_T *org = 0;
+  FILE *f;
+  unsigned long n = 0;
+  int format, stopped = 0;
+
+  if (line > DAS_length (buffer))
     {
-      DSappendcstr (s, buffer, NPOS);
-      if (DSget_at (s, DSlength (s) - 1) == '\n')
-	break;
+      json_puts ("error", "entry_error", G00003);
+      return;
     }
-  return s;
+  f = strcmp (filename, "-") == 0 ? stdin : fopen (filename, "r");
+  if (f)
+    {
+      /* build the new lines on the side, then move them all in at once */
+      lines = DAS_create ();
+      format = zio_detect (f);
+#ifdef KEEP_ORIGIN
+      /* a compressed file holds no lines that could be copied as is */
+      if (original && f != stdin && format == ZIO_PLAIN)
+	org = ORG_create ();
+#endif
+      fio_load (f, format, lines, org);
+      /* an interrupted load leaves the buffer as it was */
+      if (!(stopped = cancelled ()))
+	{
+	  n = DAS_length (lines);
+	  edit_splice (line, lines, org);
+	}
+      DAS_destroy (lines);
+      if (org != 0)
+	ORG_destroy (org);
+      if (org != 0 && !stopped)
+	{
+	  origin_close ();
+#ifdef KEEP_ORIGIN
+	  origin_fd = dup (fileno (f));
+#endif
+	}
+      if (f != stdin)
+	fclose (f);
+    }
+  if (stopped)
+    json_puts ("status", "interrupted", G00058);
+  else
+    report_lines ("read", filename, n, G00004, G00005);
+}
+
+/* load_file - read the file being edited into the buffer */
+void
+load_file (char *filename)
+{
+  merge_file (0, filename, 1);
+  changed = 0;
 }
 
 /* transfer_file - merges the contents of a file on disk with a file in memory
- */
+   (a filename of "-" means the standard input) */
 void
 transfer_file (unsigned long line, char *filename)
 {
-  STRING_T *s = 0;
+  merge_file (line, filename, 0);
+}
+
+/* save_format - the format filename is to be written in: a file that
+   was compressed stays compressed */
+static int
+save_format (char *filename)
+{
+  int format = zio_format_of_name (filename);
   FILE *f;
-  unsigned long init_line = line;
 
-  if (line > DAS_length (buffer))
+  if (format == ZIO_PLAIN && (f = fopen (filename, "r")) != 0)
     {
-      puts (G00003);
-      return;
+      format = zio_detect (f);
+      fclose (f);
     }
-  if ((f = fopen (filename, "r")))
+  return format;
+}
+
+/* write_stop - whether writing should stop at line, looking every few
+   thousand lines past *check (and saying how far it has got) */
+static int
+write_stop (size_t line, size_t * check)
+{
+  if (line < *check)
+    return 0;
+  if (cancelled ())
+    return 1;
+  progress_at (line);
+  *check = line + 4096;
+  return 0;
+}
+
+/* write_lines - write lines first up to (but not including) last;
+   returns where it stopped, which is last unless it was interrupted */
+static size_t
+write_lines (FIO_WRITER * w, size_t first, size_t last)
+{
+  STRING_T *s;
+  size_t i, j, run, check = first;
+  off_t bytes;
+
+  progress_start (PROGRESS_LINES, first, last);
+  for (i = first; i < last && !write_stop (i, &check); i += run)
     {
-      while (DSlength (s = read_from_file (f, s)) != 0)
+      /* copy what has not changed straight from the original file */
+      run = unchanged_run (i, last, &bytes);
+      if (bytes >= COPY_MIN && (off_t) (size_t) bytes == bytes
+	  && fio_copy (w, origin_fd, *ORG_get_at (origin, i), bytes) == 0)
+	continue;
+      if (run == 0)
+	run = 1;
+      for (j = i; j < i + run && !write_stop (j, &check); ++j)
 	{
-	  /* remove newline and add s to buffer */
-	  DSresize (s, DSlength (s) - 1, 0);
-	  DAS_insert (buffer, line++, s, 1, 1);
+	  if (j + 8 < last)
+	    DSprefetch (DAS_get_at (buffer, j + 8));
+	  s = DAS_get_at (buffer, j);
+	  fio_write (w, DScstr (s), DSlength (s));
+	  fio_write (w, "\n", 1);
+	}
+      if (j < i + run)
+	{
+	  i = j;
+	  break;
 	}
-      fclose (f);
     }
-  printf ((line - init_line == 1) ? G00004 : G00005, filename,
-	  line - init_line);
-  if (s)
-    DSdestroy (s);
+  progress_end ();
+  return i < last ? i : last;
 }
 
-/* write X number of lines to a file */
-void
+/* write X number of lines to a file; returns nonzero if that failed */
+int
 write_file (unsigned long lines, char *filename)
 {
   FILE *f;
-  size_t i;
+  FIO_WRITER *w;
+  size_t i, done;
+  int format = save_format (filename), error = -1;
 
   make_bakfile (filename);
+  origin_overwrite (filename);
   if ((f = fopen (filename, "w")))
     {
       i = DAS_length (buffer);
       if (lines >= i)
 	lines = i;
-      for (i = 0; i < lines; i++)
+      w = fio_writer (f, FIO_SAVE, format);
+      done = write_lines (w, 0, lines);
+      error = fio_close (w);
+      /* the writer gives up on a copy it is in the middle of, too */
+      if (error != 0 && cancelled ())
+	done = 0;
+      if (error == 0 && done == DAS_length (buffer) && format == ZIO_PLAIN)
+	origin_rebase (filename);
+      if (fclose (f) != 0 || done < lines)
+	error = -1;
+      if (done < lines)
+	json_puts ("status", "interrupted", G00058);
+      else if (error != 0)
+	write_failed (filename);
+      else
+	report_lines ("written", filename, (unsigned long) lines, G00006,
+		      G00007);
+    }
+  return error;
+}
+
+/* write_block - write lines line1 through line2 to a file, or add them
+   to the end of it, leaving the file being edited alone */
+void
+write_block (unsigned long line1, unsigned long line2, char *filename,
+	     int append)
+{
+  FILE *f;
+  FIO_WRITER *w;
+  size_t done;
+  int format = save_format (filename), error;
+
+  if (line2 >= DAS_length (buffer))
+    line2 = DAS_length (buffer) - 1;
+  if (line1 > line2 || line2 >= DAS_length (buffer))
+    {
+      json_puts ("error", "entry_error", G00003);
+      return;
+    }
+  /* writing to the file being edited, even just to the end of it,
+     means it can no longer be read from while it is written */
+  origin_overwrite (filename);
+  /* an append goes on from the end of the file rather than through
+     O_APPEND, so that the pieces can still be written out of order */
+  if (append && file_exists (filename))
+    {
+      if ((f = fopen (filename, "r+")) != 0 && fseek (f, 0L, SEEK_END) != 0)
 	{
-	  fputs ((const char *) DScstr (DAS_get_at (buffer, i)), f);
-	  fputc ('\n', f);
+	  fclose (f);
+	  f = 0;
 	}
-      fclose (f);
-      printf ((i == 1) ? G00006 : G00007, filename, (unsigned long) i);
     }
+  else
+    f = fopen (filename, "w");
+  if (f == 0)
+    {
+      if (json_output)
+	json_record ("error", "cannot_open", filename);
+      else
+	printf (G00048, filename);
+      return;
+    }
+  w = fio_writer (f, FIO_SAVE, format);
+  done = write_lines (w, line1, line2 + 1);
+  error = fio_close (w);
+  if (error != 0 && cancelled ())
+    done = line1;
+  if (fclose (f) != 0)
+    error = -1;
+  if (done <= line2)
+    json_puts ("status", "interrupted", G00058);
+  else if (error != 0)
+    write_failed (filename);
+  else
+    report_lines ("written", filename, line2 - line1 + 1, G00006, G00007);
+}
+
+/* put_word - put n into the session word at p */
+static void
+put_word (unsigned char *p, off_t n)
+{
+  int i;
+
+  if (n == SESSION_NONE)
+    memset (p, 0xFF, SESSION_WORD);
+  else
+    for (i = 0; i < SESSION_WORD; ++i, n >>= 8)
+      p[i] = (unsigned char) (n & 0xFF);
+}
+
+/* get_word - the session word at p, or SESSION_NONE if it is nothing
+   or too big to be an off_t */
+static off_t
+get_word (const char *p)
+{
+  const unsigned char *q = (const unsigned char *) p;
+  off_t n = 0;
+  int i;
+
+  for (i = SESSION_WORD - 1; i >= 0; --i)
+    {
+      if (n > (((off_t) 1 << (sizeof (off_t) * CHAR_BIT - 9)) - 1))
+	return SESSION_NONE;
+      n = (n << 8) | q[i];
+    }
+  return n;
+}
+
+/* whole_read - read all of f into w; returns zero if that failed */
+static int
+whole_read (FILE * f, WHOLE * w)
+{
+  struct stat st;
+
+  w->p = 0;
+  w->len = 0;
+  w->mapped = 0;
+  if (fstat (fileno (f), &st) != 0
+      || (off_t) (size_t) st.st_size != st.st_size)
+    return 0;
+  if ((w->len = (size_t) st.st_size) == 0)
+    return 1;
+#ifdef SESSION_MMAP
+  w->p = mmap (0, w->len, PROT_READ, MAP_PRIVATE, fileno (f), 0);
+  if (w->p != MAP_FAILED)
+    {
+#ifdef MADV_SEQUENTIAL
+      madvise (w->p, w->len, MADV_SEQUENTIAL);
+#endif
+      w->mapped = 1;
+      return 1;
+    }
+#endif
+  if ((w->p = malloc (w->len)) == 0)
+    Nomemory ();
+  if (fread (w->p, 1, w->len, f) == w->len)
+    return 1;
+  free (w->p);
+  w->p = 0;
+  return 0;
+}
+
+/* whole_free - let go of what whole_read read */
+static void
+whole_free (WHOLE * w)
+{
+#ifdef SESSION_MMAP
+  if (w->mapped)
+    munmap (w->p, w->len);
+  else
+#endif
+    free (w->p);
+  w->p = 0;
+}
+
+/* save_session - write the buffer, its marks and current_line to the
+   session file filename, with the lines that are as they were in the
+   original file (called edited) kept as where they are in it */
+void
+save_session (char *filename, unsigned long current_line, char *edited)
+{
+  STRING_T *head = DScreate (), *runs = DScreate ();
+  unsigned char word[SESSION_RUN];
+  size_t i, j, n, nruns = 0;
+  off_t at, end, payload = 0;
+  struct stat st;
+  FIO_WRITER *w;
+  FILE *f;
+  int error, keep;
+
+  commit_edits ();
+  /* a session saved over the original file cannot point into it */
+  origin_overwrite (filename);
+  n = DAS_length (buffer);
+  keep = origin_fd >= 0 && edited != 0 && fio_same_file (origin_fd, edited)
+    && fstat (origin_fd, &st) == 0;
+  for (i = 0; i < n; i = j, nruns++)
+    {
+      at = keep ? *ORG_get_at (origin, i) : FIO_NOWHERE;
+      if (at != FIO_NOWHERE)
+	{
+	  /* lines that still follow one another in the original file */
+	  for (j = i, end = at; j < n && *ORG_get_at (origin, j) == end; ++j)
+	    end += DSlength (DAS_get_at (buffer, j)) + 1;
+	  put_word (word + SESSION_WORD, at);
+	  put_word (word + 2 * SESSION_WORD, end - at - 1);
+	}
+      else
+	{
+	  put_word (word + SESSION_WORD, payload);
+	  put_word (word + 2 * SESSION_WORD, SESSION_NONE);
+	  for (j = i; j < n && (!keep
+				|| *ORG_get_at (origin, j) == FIO_NOWHERE); ++j)
+	    payload += SESSION_WORD + DSlength (DAS_get_at (buffer, j));
+	}
+      put_word (word, (off_t) (j - i));
+      DSappendcstr (runs, (char *) word, SESSION_RUN);
+    }
+  DSassigncstr (head, SESSION_MAGIC, SESSION_WORD);
+  DSresize (head, SESSION_HEAD, 0);
+  put_word ((unsigned char *) DScstr (head) + SESSION_WORD
+	    * (1 + SESSION_LINES), (off_t) n);
+  put_word ((unsigned char *) DScstr (head) + SESSION_WORD
+	    * (1 + SESSION_RUNS), (off_t) nruns);
+  put_word ((unsigned char *) DScstr (head) + SESSION_WORD
+	    * (1 + SESSION_CURRENT), (off_t) current_line);
+  put_word ((unsigned char *) DScstr (head) + SESSION_WORD
+	    * (1 + SESSION_CHANGED), (off_t) changed);
+  put_word ((unsigned char *) DScstr (head) + SESSION_WORD
+	    * (1 + SESSION_SIZE), keep ? st.st_size : SESSION_NONE);
+  put_word ((unsigned char *) DScstr (head) + SESSION_WORD
+	    * (1 + SESSION_MTIME), keep ? (off_t) st.st_mtime : SESSION_NONE);
+  put_word ((unsigned char *) DScstr (head) + SESSION_WORD
+	    * (1 + SESSION_NAME), edited != 0 ? (off_t) strlen (edited) : 0);
+  for (i = 0; i < MARKS; ++i)
+    put_word ((unsigned char *) DScstr (head) + SESSION_WORD
+	      * (1 + SESSION_MARKS + i),
+	      marks[i] != NPOS ? (off_t) marks[i] : SESSION_NONE);
+  if (edited != 0)
+    DSappendcstr (head, edited, NPOS);
+  DSresize (head, (DSlength (head) + SESSION_WORD - 1)
+	    / SESSION_WORD * SESSION_WORD, 0);
+  if ((f = fopen (filename, "wb")) == 0)
+    {
+      if (json_output)
+	json_record ("error", "cannot_open", filename);
+      else
+	printf (G00048, filename);
+    }
+  else
+    {
+      w = fio_writer (f, FIO_SAVE, ZIO_PLAIN);
+      fio_write (w, DScstr (head), DSlength (head));
+      fio_write (w, DScstr (runs), DSlength (runs));
+      for (i = 0; i < n; ++i)
+	if (!keep || *ORG_get_at (origin, i) == FIO_NOWHERE)
+	  {
+	    put_word (word, (off_t) DSlength (DAS_get_at (buffer, i)));
+	    fio_write (w, (char *) word, SESSION_WORD);
+	    fio_write (w, DScstr (DAS_get_at (buffer, i)),
+		       DSlength (DAS_get_at (buffer, i)));
+	  }
+      error = fio_close (w);
+      if (fclose (f) != 0 || error != 0)
+	write_failed (filename);
+      else
+	report_lines ("written", filename, (unsigned long) n, G00006,
+		      G00007);
+    }
+  DSdestroy (head);
+  DSdestroy (runs);
+}
+
+/* session_line - add the n characters at s, found at offset at of the
+   original file, to lines and org, into segments as fio_load does */
+static void
+session_line (DAS_ARRAY_T * lines, ORG_ARRAY_T * org, DSSEG ** seg,
+	      char *s, size_t n, off_t at)
+{
+  static STRING_T empty;
+  STRING_T *ds;
+
+  DAS_append (lines, &empty, 1, 1);
+  ds = DAS_get_at (lines, DAS_length (lines) - 1);
+  if (*seg == 0 || !DSassign_seg (ds, *seg, s, n))
+    {
+      DSseg_close (*seg);
+      if ((*seg = DSseg_create ()) == 0 || !DSassign_seg (ds, *seg, s, n))
+	DSassigncstr (ds, s, n);
+    }
+  ORG_append (org, &at, 1, 1);
+}
+
+/* session_runs - build lines and org from the runs of the session in
+   ses, with the original file in orig; returns zero if the session is
+   damaged or does not fit the original file */
+static int
+session_runs (WHOLE * ses, WHOLE * orig, size_t names, DAS_ARRAY_T * lines,
+	      ORG_ARRAY_T * org)
+{
+  char *run = ses->p + SESSION_HEAD + names, *payload, *s, *e, *nl;
+  off_t nruns = get_word (ses->p + SESSION_WORD * (1 + SESSION_RUNS));
+  off_t count, where, bytes, len;
+  DSSEG *seg = 0;
+  int ok = 1;
+
+  if (nruns == SESSION_NONE || (off_t) (size_t) nruns != nruns
+      || (size_t) nruns > (ses->len - SESSION_HEAD - names) / SESSION_RUN)
+    return 0;
+  payload = run + (size_t) nruns * SESSION_RUN;
+  for (; ok && nruns > 0; nruns--, run += SESSION_RUN)
+    {
+      count = get_word (run);
+      where = get_word (run + SESSION_WORD);
+      bytes = get_word (run + 2 * SESSION_WORD);
+      if (count == SESSION_NONE || where == SESSION_NONE)
+	ok = 0;
+      else if (bytes != SESSION_NONE)
+	{
+	  /* lines as they are in the original file */
+	  if ((size_t) where > orig->len
+	      || (size_t) bytes > orig->len - (size_t) where)
+	    ok = 0;
+	  for (s = orig->p + where, e = s + bytes; ok && count > 0; count--)
+	    {
+	      if ((nl = memchr (s, '\n', (size_t) (e - s))) == 0)
+		nl = e;
+	      if ((nl == e) != (count == 1))
+		ok = 0;
+	      else
+		session_line (lines, org, &seg, s, (size_t) (nl - s),
+			      (off_t) (s - orig->p));
+	      s = nl + 1;
+	    }
+	}
+      else
+	{
+	  /* lines of the payload */
+	  e = ses->p + ses->len;
+	  if ((size_t) where > (size_t) (e - payload))
+	    ok = 0;
+	  for (s = payload + where; ok && count > 0; count--)
+	    {
+	      if (e - s < SESSION_WORD
+		  || (len = get_word (s)) == SESSION_NONE
+		  || (size_t) len > (size_t) (e - s) - SESSION_WORD)
+		ok = 0;
+	      else
+		{
+		  session_line (lines, org, &seg, s + SESSION_WORD,
+				(size_t) len, FIO_NOWHERE);
+		  s += SESSION_WORD + len;
+		}
+	    }
+	}
+    }
+  DSseg_close (seg);
+  return ok;
+}
+
+/* restore_session - replace the buffer with the session saved in
+   filename; returns the name of the file that was being edited (which
+   is empty if there was none) and puts the current line then into
+   *current_line, or returns a null pointer if it cannot be restored */
+char *
+restore_session (char *filename, unsigned long *current_line)
+{
+  static STRING_T *name = 0;
+  DAS_ARRAY_T *lines;
+  ORG_ARRAY_T *org;
+  WHOLE ses, orig;
+  FILE *f, *o = 0;
+  struct stat st;
+  off_t n = 0, len = 0, size, mark;
+  size_t names = 0;
+  int i, ok;
+
+  if (name == 0)
+    name = DScreate ();
+  if ((f = fopen (filename, "rb")) == 0)
+    {
+      if (json_output)
+	json_record ("error", "cannot_open", filename);
+      else
+	printf (G00048, filename);
+      return 0;
+    }
+  orig.p = 0;
+  orig.len = 0;
+  orig.mapped = 0;
+  ok = whole_read (f, &ses) && ses.len >= SESSION_HEAD
+    && memcmp (ses.p, SESSION_MAGIC, SESSION_WORD) == 0
+    && (n = get_word (ses.p + SESSION_WORD * (1 + SESSION_LINES)))
+    != SESSION_NONE
+    && (len = get_word (ses.p + SESSION_WORD * (1 + SESSION_NAME)))
+    != SESSION_NONE && (size_t) len <= ses.len - SESSION_HEAD;
+  if (ok)
+    {
+      names = ((size_t) len + SESSION_WORD - 1) / SESSION_WORD * SESSION_WORD;
+      ok = names <= ses.len - SESSION_HEAD;
+      DSassigncstr (name, ses.p + SESSION_HEAD, (size_t) len);
+      size = get_word (ses.p + SESSION_WORD * (1 + SESSION_SIZE));
+      /* lines kept as where they are in the original file need it to be
+	 just as it was */
+      if (ok && size != SESSION_NONE)
+	ok = (o = fopen (DScstr (name), "rb")) != 0
+	  && fstat (fileno (o), &st) == 0 && st.st_size == size
+	  && (off_t) st.st_mtime
+	  == get_word (ses.p + SESSION_WORD * (1 + SESSION_MTIME))
+	  && whole_read (o, &orig);
+    }
+  lines = DAS_create ();
+  org = ORG_create ();
+  /* every line takes at least a byte of one file or the other, so this
+     keeps a damaged header from asking for more than there can be */
+  if (ok && (size_t) n <= ses.len + orig.len)
+    {
+      DAS_set_reserve (lines, (size_t) n);
+      ORG_set_reserve (org, (size_t) n);
+    }
+  if (ok)
+    ok = session_runs (&ses, &orig, names, lines, org)
+      && (off_t) DAS_length (lines) == n;
+  if (ok)
+    {
+      destroy_buffer ();
+      create_buffer ();
+      edit_splice (0, lines, org);
+#ifdef KEEP_ORIGIN
+      if (o != 0)
+	origin_fd = dup (fileno (o));
+#endif
+      changed = get_word (ses.p + SESSION_WORD * (1 + SESSION_CHANGED)) != 0;
+      for (i = 0; i < MARKS; ++i)
+	{
+	  mark = get_word (ses.p + SESSION_WORD * (1 + SESSION_MARKS + i));
+	  marks[i] = mark != SESSION_NONE && mark < n ? (size_t) mark : NPOS;
+	}
+      len = get_word (ses.p + SESSION_WORD * (1 + SESSION_CURRENT));
+      *current_line = len == SESSION_NONE ? 1
+	: len > n ? (unsigned long) n : (unsigned long) len;
+      report_lines ("read", filename, (unsigned long) n, G00004, G00005);
+    }
+  else if (json_output)
+    json_record ("error", "bad_session", filename);
+  else
+    printf (G00070, filename);
+  DAS_destroy (lines);
+  ORG_destroy (org);
+  if (orig.p != 0)
+    whole_free (&orig);
+  if (ses.p != 0)
+    whole_free (&ses);
+  if (o != 0)
+    fclose (o);
+  fclose (f);
+  return ok ? DScstr (name) : 0;
 }
 
 /* copy a block of lines elsewhere in the buffer */
@@ -322,18 +1452,21 @@ copy_block (unsigned long line1, unsigned long line2,
 	    unsigned long line3, size_t count)
 {
   DAS_ARRAY_T *s = DAS_create ();
+  ORG_ARRAY_T *org = ORG_create ();
   size_t numlines = DAS_length (buffer);
   size_t i;
 
   if (line1 >= numlines || line2 >= numlines || line3 > numlines ||
       (line1 < line3 && line3 <= line2))
-    puts (G00003);
+    json_puts ("error", "entry_error", G00003);
   else
     {
       DAS_subarray (buffer, s, line1, line2 - line1 + 1);
+      ORG_subarray (origin, org, line1, line2 - line1 + 1);
       for (i = 0; i < count; ++i)
-	DAS_insert (buffer, line3, DAS_base (s), DAS_length (s), 1);
+	edit_insert (line3, DAS_base (s), ORG_base (org), DAS_length (s));
     }
+  ORG_destroy (org);
   DAS_destroy (s);
 }
 
@@ -341,16 +1474,17 @@ copy_block (unsigned long line1, unsigned long line2,
 void
 delete_block (unsigned long line1, unsigned long line2)
 {
-  size_t numlines = DAS_length (buffer);
+  size_t numlines = get_last_line ();
 
   if (line1 > numlines)
     line1 = numlines - 1;
   if (line2 > numlines)
     line2 = numlines - 1;
-  if (line1 > line2)
-    puts (G00003);
+  /* with no lines at all, numlines - 1 is no line either */
+  if (line1 > line2 || numlines == 0)
+    json_puts ("error", "entry_error", G00003);
   else
-    DAS_remove (buffer, line1, line2 - line1 + 1);
+    edit_remove (line1, line2 - line1 + 1);
 }
 
 /* move the block from line1 to line2 to immediately before line3 */
@@ -358,26 +1492,23 @@ void
 move_block (unsigned long line1, unsigned long line2, unsigned long line3)
 {
   DAS_ARRAY_T *s = DAS_create ();
-  size_t numlines = DAS_length (buffer);
+  ORG_ARRAY_T *org = ORG_create ();
+  size_t numlines = get_last_line ();
 
   if (line1 >= numlines || line2 >= numlines || line3 > numlines
       || (line1 < line3 && line3 <= line2))
-    puts (G00003);
+    json_puts ("error", "entry_error", G00003);
   else
     {
       numlines = line2 - line1 + 1;
-      DAS_subarray (buffer, s, line1, numlines);
-      if (line3 >= line2)
-	{
-	  DAS_insert (buffer, line3, DAS_base (s), numlines, 1);
-	  DAS_remove (buffer, line1, numlines);
-	}
-      else
+      if (!defer)
 	{
-	  DAS_remove (buffer, line1, numlines);
-	  DAS_insert (buffer, line3, DAS_base (s), numlines, 1);
+	  DAS_subarray (buffer, s, line1, numlines);
+	  ORG_subarray (origin, org, line1, numlines);
 	}
+      edit_move (line1, numlines, line3, DAS_base (s), ORG_base (org));
     }
+  ORG_destroy (org);
   DAS_destroy (s);
 }
 
@@ -394,12 +1525,13 @@ read_line (char *prompt)
   if (ds == 0)
     ds = DScreate ();
   DSresize (ds, 0, 0);
-  fputs (prompt, stdout);
+  if (!json_output)
+    fputs (prompt, stdout);
   fflush (stdout);
 #ifndef SHIFT_JIS
   /* Normal terminal input. Assumes that I don't have to handle control
      characters here.  */
-  while ((c = getchar ()) != EOF && c != '\n')
+  while ((c = line_edit_getc ()) != EOF && c != '\n')
     DSappendchar (ds, c, 1);
 #else /* SHIFT_JIS */
   /* Rolling our own getchar loop here. The thing to watch out for is that a
@@ -448,19 +1580,47 @@ display_block (unsigned long first_line,
 	       unsigned long current_line, size_t page_size)
 {
   unsigned long i;
-  size_t lines_written;
+  size_t lines_written, extra;
+  FIO_WRITER *w;
+  STRING_T *s;
+  char *fmt, *p;
+
+  /* the lines are formatted straight into the writer's buffer; extra is
+     room for the rest of the format and the line number */
+  fmt = G00008;
+  extra = strlen (fmt) + 3 * sizeof (unsigned long) + 2;
+  fflush (stdout);
+  w = fio_writer (stdout, FIO_STREAM, ZIO_PLAIN);
   for (i = first_line, lines_written = 0;
        i <= last_line && i < DAS_length (buffer); i++)
     {
-      printf (G00008, i + 1, i == current_line ? '*' : ' ',
-	      DScstr (DAS_get_at (buffer, i)));
+      if (json_output)
+	{
+	  /* one record a line, and no pages */
+	  s = line_record ("line", i, DAS_get_at (buffer, i),
+			   i == current_line);
+	  fio_write (w, DScstr (s), DSlength (s));
+	  continue;
+	}
+      s = DAS_get_at (buffer, i);
+      if ((p = fio_reserve (w, DSlength (s) + extra)) != 0)
+	fio_commit (w, sprintf (p, fmt, i + 1, i == current_line ? '*' : ' ',
+				DScstr (s)));
+      else
+	{
+	  fio_flush (w);
+	  printf (fmt, i + 1, i == current_line ? '*' : ' ', DScstr (s));
+	  fflush (stdout);
+	}
       lines_written++;
       if (lines_written == page_size && i != last_line)
 	{
+	  fio_flush (w);
 	  read_line (G00009);
 	  lines_written = 0;
 	}
     }
+  fio_close (w);
 }
 
 /* translate_string - translate a string with escapes into regular string */
@@ -471,10 +1631,11 @@ translate_string (char *s, int tc)
   /* The following are arrays of characters to foil cstrings, as
      they are not to be translated.  */
   static char escs[] = {
-    'a', 'b', 'e', 'f', 't', 'v', '\\', '\'', '\"', '.', '\0'
+    'a', 'b', 'e', 'f', 't', 'v', '\\', '\'', '\"', '.', '/', '?', '\0'
   };
   static char xlat[] = {
-    '\a', '\b', '\033', '\f', '\t', '\v', '\\', '\'', '\"', '.', '\0'
+    '\a', '\b', '\033', '\f', '\t', '\v', '\\', '\'', '\"', '.', '/', '?',
+    '\0'
   };
   static char xdigs[] = {
     '0', '1', '2', '3', '4', '5', '6', '7', '8', '9',
@@ -560,18 +1721,31 @@ translate_string (char *s, int tc)
 void
 modify_line (unsigned long line)
 {
-  char *new_line;
-  STRING_T *xline;
+  char *new_line, prompt[32];
+  STRING_T *xline, *old;
   if (line > DAS_length (buffer))
     {
-      puts (G00003);
+      json_puts ("error", "entry_error", G00003);
       return;
     }
   display_block (line, line, line, 1);
-  printf (G00010, line + 1);
+  if (!json_output && line_edit_ready ())
+    {
+      /* edit the old line in place of typing it out again */
+      sprintf (prompt, G00010, line + 1);
+      old = line < DAS_length (buffer) ? DAS_get_at (buffer, line) : 0;
+      xline = DScreate ();
+      if (line_edit (prompt, old != 0 ? DScstr (old) : "",
+		     old != 0 ? DSlength (old) : 0, xline) == LINE_EDIT_DONE)
+	edit_put ((size_t) line, xline);
+      DSdestroy (xline);
+      return;
+    }
+  if (!json_output)
+    printf (G00010, line + 1);
   new_line = read_line ("");
   xline = translate_string (new_line, 0);
-  DAS_put_at (buffer, (size_t) (line), xline);
+  edit_put ((size_t) line, xline);
 }
 
 /* insert_block - go into insert mode */
@@ -580,59 +1754,474 @@ insert_block (unsigned long line)
 {
   char *new_line;
   STRING_T *xline;
-  if (line > DAS_length (buffer))
-    line = DAS_length (buffer);
+  if (line > get_last_line ())
+    line = get_last_line ();
   while ((new_line = read_line (G00001)) != 0 && strcmp (new_line, ".") != 0)
     {
       xline = translate_string (new_line, 0);
       if (DSlength (xline) > 0 && DSget_at (xline, 0) == '\032')
 	break;
-      DAS_insert (buffer, line++, xline, 1, 1);
+      edit_insert (line++, xline, 0, 1);
     }
-  if (new_line == 0)
+  if (new_line == 0 && !json_output)
     putchar ('\n');
-  return line + 1 < DAS_length (buffer) ? line + 1 : DAS_length (buffer);
+  return line + 1 < get_last_line () ? line + 1 : get_last_line ();
+}
+
+/* blocks_prepare - make room for the summaries of all the whole blocks
+   in the buffer, before it is searched */
+static void
+blocks_prepare (void)
+{
+  size_t n = DAS_length (buffer) / BLOCK_LINES;
+  unsigned char *state;
+  SUMMARY *sum;
+
+  if (n <= blocks)
+    return;
+  if ((state = realloc (block_state, n)) == 0)
+    Nomemory ();
+  block_state = state;
+  if ((sum = realloc (summaries, n * sizeof (SUMMARY))) == 0)
+    Nomemory ();
+  summaries = sum;
+  memset (block_state + blocks, BLOCK_UNKNOWN, n - blocks);
+  blocks = n;
+}
+
+/* summary_need - set up need with what the string ds holds */
+static void
+summary_need (SUMMARY * need, STRING_T * ds)
+{
+  memset (need, 0, sizeof (SUMMARY));
+  summary_add (need, DScstr (ds), DSlength (ds));
+}
+
+/* block_may_hold - could block b hold what need says a string holds? */
+static int
+block_may_hold (size_t b, SUMMARY * need)
+{
+  SUMMARY *sum = summaries + b;
+  size_t i;
+
+  if (block_state[b] != BLOCK_SUMMED)
+    return 1;
+  for (i = 0; i < sizeof sum->bytes / sizeof sum->bytes[0]; ++i)
+    if ((need->bytes[i] & ~sum->bytes[i]) != 0)
+      return 0;
+  for (i = 0; i < sizeof sum->pairs / sizeof sum->pairs[0]; ++i)
+    if ((need->pairs[i] & ~sum->pairs[i]) != 0)
+      return 0;
+  return 1;
+}
+
+/* block_missed - a search has gone through all of block b without
+   finding anything; if it is not the first, sum the block up */
+static void
+block_missed (size_t b)
+{
+  unsigned char *bytes, *pairs;
+  const unsigned char *t, *end;
+  SUMMARY *sum = summaries + b;
+  STRING_T *ds;
+  size_t line, i;
+  unsigned c, prev;
+
+  if (block_state[b] == BLOCK_UNKNOWN)
+    {
+      block_state[b] = BLOCK_MISSED;
+      return;
+    }
+  /* a byte for each bit, which can be set without reading it first;
+     without room for them, the block just goes without a summary */
+  if (block_state[b] != BLOCK_MISSED
+      || (bytes = calloc (UCHAR_MAX + 1 + PAIR_BITS, 1)) == 0)
+    return;
+  pairs = bytes + UCHAR_MAX + 1;
+  for (line = b * BLOCK_LINES; line < (b + 1) * BLOCK_LINES; ++line)
+    {
+      ds = DAS_get_at (buffer, line);
+      t = (const unsigned char *) DScstr (ds);
+      end = t + DSlength (ds);
+      if (t == end)
+	continue;
+      prev = *t++;
+      bytes[prev] = 1;
+      for (; t < end; prev = c)
+	{
+	  c = *t++;
+	  bytes[c] = 1;
+	  pairs[PAIR_HASH (prev, c)] = 1;
+	}
+    }
+  memset (sum, 0, sizeof (SUMMARY));
+  for (i = 0; i <= UCHAR_MAX; ++i)
+    if (bytes[i])
+      sum->bytes[i / LONG_BITS] |= 1UL << (i % LONG_BITS);
+  for (i = 0; i < PAIR_BITS; ++i)
+    if (pairs[i])
+      sum->pairs[i / LONG_BITS] |= 1UL << (i % LONG_BITS);
+  free (bytes);
+  block_state[b] = BLOCK_SUMMED;
+}
+
+/* find_in - find the first m characters at t in the n at s.  Going from
+   one place the first character is to the next is quickest when it is
+   rare; when it turns out not to be, the library does the rest.  */
+static char *
+find_in (char *s, size_t n, char *t, size_t m)
+{
+  char *e, *p;
+#ifdef HAVE_MEMMEM
+  char *start = s;
+  size_t misses = 0;
+#endif
+
+  if (n < m)
+    return 0;
+  for (e = s + n - m + 1; (p = memchr (s, *t, e - s)) != 0; s = p + 1)
+    {
+      if (memcmp (p, t, m) == 0)
+	return p;
+#ifdef HAVE_MEMMEM
+      if (++misses > 8 && misses > (size_t) (p - start) / 32)
+	return memmem (p + 1, e - p - 1 + m - 1, t, m);
+#endif
+    }
+  return 0;
+}
+
+/* find_run - find_line for a stretch of at most a few hundred lines.
+   Lines loaded from a file lie one after another in memory, each ended
+   by a null character, so as long as the string holds no null
+   character, all of a run of such lines can be searched at once.  */
+static unsigned long
+find_run (FIND * f, unsigned long first, unsigned long last)
+{
+  STRING_T *base = DAS_base (buffer), *ds, *e = base + last, *q;
+  char *t = DScstr (f->ds), *hit;
+  size_t m = DSlength (f->ds);
+
+  if (f->fuzzy != 0 || memchr (t, '\0', m) != 0)
+    {
+      for (ds = base + first; ds < e; ++ds)
+	{
+	  if (ds + 8 < e)
+	    DSprefetch (ds + 8);
+	  if (f->fuzzy != 0
+	      ? fuzzy_match (f->fuzzy, DScstr (ds), DSlength (ds))
+	      : DSfind (ds, t, 0, m) != NPOS)
+	    return (unsigned long) (ds - base);
+	}
+      return POOL_NONE;
+    }
+  for (ds = base + first; ds < e; ds = q)
+    {
+      for (q = ds + 1;
+	   q < e && DScstr (q) == DScstr (q - 1) + DSlength (q - 1) + 1; ++q)
+	;
+      hit = find_in (DScstr (ds), DScstr (q - 1) + DSlength (q - 1)
+		     - DScstr (ds), t, m);
+      if (hit != 0)
+	{
+	  /* the match cannot run on past the end of its line */
+	  while (DScstr (ds) + DSlength (ds) < hit + m)
+	    ++ds;
+	  return (unsigned long) (ds - base);
+	}
+    }
+  return POOL_NONE;
+}
+
+/* find_line - pool_find_fn that finds the first line containing a
+   string.  The work is only ever split up on block boundaries, so a
+   whole block lies in one call or none and no two threads look at the
+   same block's state unless neither of them changes it.  */
+static unsigned long
+find_line (void *arg, unsigned long first, unsigned long last)
+{
+  FIND *f = arg;
+  unsigned long end, next, found;
+  size_t b;
+  int whole;
+
+  while (first < last)
+    {
+      b = (size_t) (first / BLOCK_LINES);
+      end = (unsigned long) (b + 1) * BLOCK_LINES;
+      whole = f->need != 0 && b < blocks && first % BLOCK_LINES == 0
+	&& end <= last;
+      if (f->need != 0 && b < blocks && !block_may_hold (b, f->need))
+	{
+	  first = end < last ? end : last;
+	  continue;
+	}
+      if (end > last)
+	end = last;
+      for (; first < end; first = next)
+	{
+	  if (cancelled () || (f->stop != 0 && *f->stop))
+	    return POOL_NONE;
+	  if (f->report)
+	    progress_at (first);
+	  next = (first | 255) + 1;
+	  if (next > end)
+	    next = end;
+	  if ((found = find_run (f, first, next)) != POOL_NONE)
+	    return found;
+	}
+      if (whole)
+	block_missed (b);
+    }
+  return POOL_NONE;
+}
+
+/* spec_run - pool_task_fn that searches ahead */
+static void
+spec_run (void *arg)
+{
+  SPEC *sp = arg;
+
+  sp->found = pool_find_first (sp->first, sp->last, 0, find_line,
+			       &sp->find);
+}
+
+/* spec_start - start looking for the next line from first that holds
+   ds, unless a search is already under way; the buffer must not change
+   until spec_wait or spec_cancel has been called */
+static void
+spec_start (SPEC * sp, unsigned long first, unsigned long last,
+	    STRING_T * ds)
+{
+  if (sp->state != SPEC_IDLE || first >= last)
+    return;
+  sp->find.ds = ds;
+  sp->find.fuzzy = sp->fuzzy;
+  sp->find.need = sp->need;
+  sp->find.stop = &sp->stop;
+  sp->find.report = sp->report;
+  sp->stop = 0;
+  sp->first = first;
+  sp->last = last;
+  sp->found = POOL_NONE;
+  if ((sp->task = pool_spawn (spec_run, sp)) != 0)
+    sp->state = SPEC_RUNNING;
+}
+
+/* spec_wait - let the search ahead finish */
+static void
+spec_wait (SPEC * sp)
+{
+  if (sp->state == SPEC_RUNNING)
+    {
+      pool_join (sp->task);
+      sp->state = SPEC_DONE;
+    }
+}
+
+/* spec_cancel - stop the search ahead, and forget it */
+static void
+spec_cancel (SPEC * sp)
+{
+  if (sp->state == SPEC_RUNNING)
+    {
+      sp->stop = 1;
+      pool_join (sp->task);
+    }
+  sp->state = SPEC_IDLE;
+}
+
+/* spec_next - return the next line from first up to last that holds
+   ds, from the search ahead if it looked there */
+static unsigned long
+spec_next (SPEC * sp, unsigned long first, unsigned long last,
+	   STRING_T * ds)
+{
+  FIND f;
+
+  spec_wait (sp);
+  if (sp->state == SPEC_DONE && sp->first == first && sp->last == last)
+    {
+      sp->state = SPEC_IDLE;
+      return sp->found;
+    }
+  sp->state = SPEC_IDLE;
+  f.ds = ds;
+  f.fuzzy = sp->fuzzy;
+  f.need = sp->need;
+  f.stop = 0;
+  f.report = sp->report;
+  return pool_find_first (first, last, 0, find_line, &f);
+}
+
+/* addr_lookup - find what an earlier search for ds going the same way
+   would say about a search from line from, or return zero */
+static int
+addr_lookup (STRING_T * ds, int backward, size_t from, size_t * found)
+{
+  ADDR *a;
+
+  for (a = addr_cache; a < addr_cache + ADDR_CACHE; ++a)
+    if (a->text != 0 && a->generation == generation
+	&& a->backward == backward && DScompare (a->text, ds, 0, NPOS) == 0)
+      {
+	/* nothing lies between where that search started and what it
+	   found, so starting anywhere in between finds the same line */
+	if (backward ? from <= a->from && (a->found == NPOS
+					   || from >= a->found)
+	    : from >= a->from && (a->found == NPOS || from <= a->found))
+	  {
+	    *found = a->found;
+	    return 1;
+	  }
+      }
+  return 0;
+}
+
+/* search_address - work out the address /text/ or ?text? at *sp,
+   searching forward from the line after line or backward from the line
+   before it (both counting from 1); *sp is moved past the address.
+   Returns the line found (counting from 1) or 0.  */
+unsigned long
+search_address (char **sp, unsigned long line)
+{
+  char *s = *sp, delim = *s++;
+  int backward = delim == '?';
+  size_t numlines, from, found;
+  STRING_T *ds;
+  SUMMARY need;
+  ADDR *a;
+  FIND f;
+
+  commit_edits ();
+  numlines = DAS_length (buffer);
+  ds = translate_string (s, delim);
+  while (*s && *s != delim)
+    s += (*s == '\\' && s[1] ? 2 : 1);
+  *sp = *s ? s + 1 : s;
+  if (DSlength (ds) == 0 || (backward ? line < 2 : line >= numlines))
+    return 0;
+  from = backward ? line - 2 : line;
+  if (!addr_lookup (ds, backward, from, &found))
+    {
+      if (!backward)
+	{
+	  blocks_prepare ();
+	  summary_need (&need, ds);
+	  f.ds = ds;
+	  f.fuzzy = 0;
+	  f.need = &need;
+	  f.stop = 0;
+	  f.report = 0;
+	  found = pool_find_first (from, numlines, 0, find_line, &f);
+	  if (found == POOL_NONE)
+	    found = NPOS;
+	}
+      else
+	for (found = from;
+	     DSfind (DAS_get_at (buffer, found), DScstr (ds), 0,
+		     DSlength (ds)) == NPOS; --found)
+	  if (found == 0)
+	    {
+	      found = NPOS;
+	      break;
+	    }
+      a = addr_cache + addr_next;
+      addr_next = (addr_next + 1) % ADDR_CACHE;
+      if (a->text == 0)
+	a->text = DScreate ();
+      DSassign (a->text, ds, 0, NPOS);
+      a->backward = backward;
+      a->from = from;
+      a->found = found;
+      a->generation = generation;
+    }
+  return found == NPOS ? 0 : (unsigned long) found + 1;
 }
 
-/* search_buffer - search a buffer for a string */
+/* search_buffer - search a buffer for a string, or with ~n in front,
+   for text within n edits of it */
 unsigned long
 search_buffer (unsigned long current_line,
 	       unsigned long line1, unsigned long line2, int verify, char *s)
 {
-  unsigned long line;
+  unsigned long line, last, edits = 0;
   STRING_T *ds;
-  int q = 0;
+  int q = 0, fuzzy = 0;
   char *yn;
   size_t numlines = DAS_length (buffer);
+  SUMMARY need;
+  SPEC spec;
 
   if (line1 > numlines || line2 > numlines)
     {
-      puts (G00003);
+      json_puts ("error", "entry_error", G00003);
       return current_line;
     }
   while (isspace ((unsigned char) *s))
     s++;
+  if (*s == '~')
+    {
+      /* one edit unless it says how many */
+      fuzzy = 1;
+      edits = isdigit ((unsigned char) *++s) ? strtoul (s, &s, 10) : 1;
+      while (isspace ((unsigned char) *s))
+	s++;
+    }
   if (*s == '\'' || *s == '\"')
     q = *s++;
   ds = translate_string (s, q);
+  last = line2 < numlines ? line2 + 1 : numlines;
+  spec.state = SPEC_IDLE;
+  /* more edits than the string is long would find every line anyway */
+  if (edits > DSlength (ds))
+    edits = DSlength (ds);
+  spec.fuzzy = fuzzy ? fuzzy_create (DScstr (ds), DSlength (ds),
+				     (unsigned) edits) : 0;
+  spec.need = 0;
+  if (!fuzzy)
+    {
+      blocks_prepare ();
+      summary_need (&need, ds);
+      spec.need = &need;
+    }
+  spec.report = 1;
+  if (!verify)
+    progress_start (PROGRESS_LINES, line1, last);
   if (DSlength (ds) != 0)
-    for (line = line1; line <= line2; ++line)
+    for (line = line1;
+	 (line = spec_next (&spec, line, last, ds)) != POOL_NONE; ++line)
       {
-	if (DSfind (DAS_get_at (buffer, (size_t) line), DScstr (ds), 0,
-		    DSlength (ds)) != NPOS)
+	if (json_output)
+	  fputs (DScstr (line_record ("hit", line, DAS_get_at (buffer, line),
+				      0)), stdout);
+	else
+	  display_block (line, line, line, 1);
+	if (verify)
 	  {
-	    display_block (line, line, line, 1);
-	    if (verify)
+	    /* look for the next one while the user thinks */
+	    spec_start (&spec, line + 1, last, ds);
+	    yn = read_line (G00002);
+	    if (*yn == 0 || strchr (YES, *yn) != 0)
 	      {
-		yn = read_line (G00002);
-		if (*yn == 0 || strchr (YES, *yn) != 0)
-		  return line + 1;
+		spec_cancel (&spec);
+		fuzzy_destroy (spec.fuzzy);
+		return line + 1;
 	      }
-	    else
-	      return line + 1;
+	  }
+	else
+	  {
+	    progress_end ();
+	    fuzzy_destroy (spec.fuzzy);
+	    return line + 1;
 	  }
       }
-  puts (G00011);
+  progress_end ();
+  fuzzy_destroy (spec.fuzzy);
+  if (cancelled ())
+    json_puts ("status", "interrupted", G00058);
+  else
+    json_puts ("status", "not_found", G00011);
   return current_line;
 }
 
@@ -642,11 +2231,15 @@ unsigned long
 replace_buffer (unsigned long current_line,
 		unsigned long line1, unsigned long line2, int verify, char *s)
 {
-  unsigned long line;
+  unsigned long line, last;
   STRING_T *ds, *ds1, *dc;
   int q = 0;
   char *yn;
   size_t origpos;
+  size_t numlines = DAS_length (buffer);
+  unsigned long replaced = 0;
+  SUMMARY need;
+  SPEC spec;
 
   while (isspace ((unsigned char) *s))
     s++;
@@ -670,9 +2263,20 @@ replace_buffer (unsigned long current_line,
     q = 0;
   ds1 = DScreate ();
   DSassign (ds1, translate_string (s, q), 0, NPOS);
+  last = line2 < numlines ? line2 + 1 : numlines;
+  spec.state = SPEC_IDLE;
+  spec.fuzzy = 0;
+  blocks_prepare ();
+  summary_need (&need, ds);
+  spec.need = &need;
+  spec.report = 0;
+  if (!verify)
+    progress_start (PROGRESS_LINES, line1, last);
   if (DSlength (ds) != 0 && DScompare (ds, ds1, 0, NPOS) != 0)
-    for (line = line1; line <= line2; line++)
+    for (line = line1; !cancelled ()
+	 && (line = spec_next (&spec, line, last, ds)) != POOL_NONE; line++)
       {
+	progress_at (line);
 	origpos = 0;
 	while ((origpos = DSfind (DAS_get_at (buffer, (size_t) line),
 				  DScstr (ds), origpos, DSlength (ds)))
@@ -681,25 +2285,226 @@ replace_buffer (unsigned long current_line,
 	    dc = DScreate ();
 	    DSassign (dc, DAS_get_at (buffer, line), 0, NPOS);
 	    DSreplace (dc, origpos, DSlength (ds), ds1, 0, NPOS);
-	    printf (G00012, line + 1, DScstr (dc));
+	    if (json_output)
+	      fputs (DScstr (line_record ("replace", line, dc, 0)), stdout);
+	    else
+	      printf (G00012, line + 1, DScstr (dc));
 	    if (verify)
-	      yn = read_line (G00002);
+	      {
+		/* look for the next line while the user thinks; it lies
+		   past this one, so changing this one does not affect it */
+		spec_start (&spec, line + 1, last, ds);
+		yn = read_line (G00002);
+	      }
 	    if (!verify || (*yn == 0 || strchr (YES, *yn) != 0))
 	      {
+		spec_wait (&spec);
 		current_line = line + 1;
 		origpos += DSlength (ds1);
-		DAS_put_at (buffer, line, dc);
+		replaced++;
+		edit_put (line, dc);
 	      }
 	    else
 	      origpos++;
 	    DSdestroy (dc);
 	  }
       }
+  progress_end ();
+  if (cancelled ())
+    json_puts ("status", "interrupted", G00058);
+  if (json_output)
+    {
+      /* the tally, which only a program would want */
+      json_begin (ds, "replaced");
+      json_number (ds, "count", replaced);
+      json_end (ds);
+      fputs (DScstr (ds), stdout);
+    }
   DSdestroy (ds);
   DSdestroy (ds1);
   return current_line;
 }
 
+/* what normalize_block does, and how far each grain of it got */
+typedef struct NORM_TALLY
+{
+  unsigned long count;		/* lines changed */
+  unsigned long last;		/* the last of them, plus one */
+} NORM_TALLY;
+
+typedef struct NORM_JOB
+{
+  int how;			/* NORM_UPPER and so on */
+  unsigned tabs;		/* how far apart the tab stops are */
+  unsigned long first;		/* the first line of the whole range */
+  NORM_TALLY *tally;		/* one for each POOL_GRAIN lines */
+} NORM_JOB;
+
+/* normalize_range - pool_range_fn that tidies the lines from first up to
+   last.  Pieces start on a multiple of POOL_GRAIN, which BLOCK_LINES
+   divides, so no two threads ever share a block or a tally.  */
+static void
+normalize_range (void *arg, unsigned long first, unsigned long last)
+{
+  NORM_JOB *job = arg;
+  NORM_TALLY *t;
+  STRING_T *s, *out = 0;
+  size_t n;
+  int done;
+
+  for (; first < last; first++)
+    {
+      if (first % 256 == 0)
+	{
+	  if (cancelled ())
+	    break;
+	  progress_at (first);
+	}
+      if (first + 8 < last)
+	DSprefetch (DAS_get_at (buffer, (size_t) first + 8));
+      s = DAS_get_at (buffer, (size_t) first);
+      switch (job->how)
+	{
+	case NORM_UPPER:
+	case NORM_LOWER:
+	  done = norm_case (DScstr (s), DSlength (s), job->how == NORM_UPPER);
+	  break;
+	case NORM_TRIM:
+	  n = norm_trim (DScstr (s), DSlength (s));
+	  if ((done = n < DSlength (s)) != 0)
+	    DSresize (s, n, 0);
+	  break;
+	default:
+	  if (out == 0)
+	    out = DScreate ();
+	  if (job->how == NORM_EXPAND)
+	    done = norm_expand (out, DScstr (s), DSlength (s), job->tabs);
+	  else
+	    done = norm_collapse (out, DScstr (s), DSlength (s), job->tabs);
+	  if (done)
+	    DSassign (s, out, 0, NPOS);
+	  break;
+	}
+      if (done)
+	{
+	  edit_changed ((size_t) first);
+	  t = job->tally + (first / POOL_GRAIN - job->first / POOL_GRAIN);
+	  t->count++;
+	  t->last = first + 1;
+	}
+    }
+  if (out != 0)
+    DSdestroy (out);
+}
+
+/* normalize_block - change the case of, or tidy the blanks in, lines
+   line1 to line2; how is one of NORM_UPPER and so on */
+unsigned long
+normalize_block (unsigned long current_line, unsigned long line1,
+		 unsigned long line2, int how, unsigned tabs)
+{
+  size_t numlines = get_last_line ();
+  unsigned long count = 0, i, grains;
+  NORM_JOB job;
+  STRING_T *ds;
+  char msg[64];
+
+  if (line2 >= numlines)
+    line2 = numlines - 1;
+  if (numlines == 0 || line1 > line2)
+    {
+      json_puts ("error", "entry_error", G00003);
+      return current_line;
+    }
+  commit_edits ();
+  grains = line2 / POOL_GRAIN - line1 / POOL_GRAIN + 1;
+  job.how = how;
+  job.tabs = tabs;
+  job.first = line1;
+  job.tally = calloc ((size_t) grains, sizeof (NORM_TALLY));
+  if (job.tally == 0)
+    Nomemory ();
+  progress_start (PROGRESS_LINES, line1, line2 + 1);
+  pool_for_range (line1, line2 + 1, POOL_GRAIN, normalize_range, &job);
+  progress_end ();
+  for (i = 0; i < grains; i++)
+    if (job.tally[i].count != 0)
+      {
+	count += job.tally[i].count;
+	current_line = job.tally[i].last;
+      }
+  free (job.tally);
+  if (count != 0)
+    {
+      changed = 1;
+      generation++;
+    }
+  if (cancelled ())
+    json_puts ("status", "interrupted", G00058);
+  if (json_output)
+    {
+      ds = DScreate ();
+      json_begin (ds, "normalized");
+      json_number (ds, "count", count);
+      json_end (ds);
+      fputs (DScstr (ds), stdout);
+      DSdestroy (ds);
+    }
+  else
+    {
+      sprintf (msg, G00063, count);
+      fputs (msg, stdout);
+    }
+  return current_line;
+}
+
+/* search_files - search the files named after a string for it */
+void
+search_files (char *s)
+{
+  DAS_ARRAY_T *names = DAS_create ();
+  STRING_T *ds, *name;
+  int q;
+  size_t n;
+
+  while (isspace ((unsigned char) *s))
+    s++;
+  if (*s == '\'' || *s == '\"')
+    q = *s++;
+  else
+    q = ',';
+  ds = DScreate ();
+  DSassign (ds, translate_string (s, q), 0, NPOS);
+  /* pick off the filenames */
+  while (*s != q && *s)
+    s += (*s == '\\' && s[1] ? 2 : 1);
+  if (*s)
+    s++;
+  name = DScreate ();
+  while (*s)
+    {
+      while (isspace ((unsigned char) *s) || *s == ',')
+	s++;
+      for (n = 0; s[n] && !isspace ((unsigned char) s[n]); ++n)
+	;
+      if (n != 0)
+	{
+	  DSassigncstr (name, s, n);
+	  batch_add (names, DScstr (name));
+	  s += n;
+	}
+    }
+  DSdestroy (name);
+  if (DSlength (ds) == 0 || DAS_length (names) == 0)
+    {
+      json_puts ("error", "entry_error", G00003);
+      DAS_destroy (names);
+    }
+  else if (find_files (names, DScstr (ds), DSlength (ds)) == 0)
+    json_puts ("status", "not_found", G00011);
+  DSdestroy (ds);
+}
+
 /* Are we really quitting the program? */
 int
 quitting (void)
@@ -714,22 +2519,153 @@ quitting (void)
 unsigned long
 get_last_line (void)
 {
-  return DAS_length (buffer);
+  return pieces != 0 ? pending : DAS_length (buffer);
 }
 
 /* initialize the buffer */
 void
 create_buffer (void)
 {
+  int i;
+
   buffer = DAS_create ();
+  origin = ORG_create ();
+  blocks_forget (0);
+  changed = 0;
+  generation++;
+  for (i = 0; i < MARKS; ++i)
+    marks[i] = NPOS;
+}
+
+/* defer edits, or not */
+void
+defer_edits (int on)
+{
+  if (!on)
+    commit_edits ();
+  defer = on;
+}
+
+/* carry out the edits that have been deferred, in a single pass */
+void
+commit_edits (void)
+{
+  DAS_ARRAY_T *lines;
+  ORG_ARRAY_T *org;
+  PIECE *p;
+  size_t i;
+
+  if (pieces == 0)
+    return;
+  blocks_forget (0);
+  lines = DAS_create ();
+  org = ORG_create ();
+  DAS_set_reserve (lines, pending);
+  ORG_set_reserve (org, pending);
+  for (i = 0; i < PIECE_length (pieces); ++i)
+    {
+      p = PIECE_get_at (pieces, i);
+      if (p->added)
+	{
+	  DAS_transfer (lines, added, p->from, p->n);
+	  ORG_append (org, &nowhere, p->n, 0);
+	}
+      else
+	{
+	  DAS_transfer (lines, buffer, p->from, p->n);
+	  ORG_append (org, ORG_get_at (origin, p->from), p->n, 1);
+	}
+    }
+  DAS_destroy (buffer);
+  ORG_destroy (origin);
+  buffer = lines;
+  origin = org;
+  PIECE_destroy (pieces);
+  DAS_destroy (added);
+  pieces = 0;
+  added = 0;
+}
+
+/* has the buffer changed since it was loaded or last saved? */
+int
+buffer_changed (void)
+{
+  return changed;
+}
+
+/* the whole buffer has been saved to the file being edited */
+void
+buffer_saved (void)
+{
+  changed = 0;
+}
+
+/* put a mark on a line */
+void
+set_mark (int mark, unsigned long line)
+{
+  if (line >= DAS_length (buffer))
+    json_puts ("error", "entry_error", G00003);
+  else
+    marks[mark] = line;
+}
+
+/* the line a mark is on */
+size_t
+get_mark (int mark)
+{
+  return marks[mark];
+}
+
+/* list the marks */
+void
+list_marks (void)
+{
+  static STRING_T *out = 0;
+  char name[2];
+  int i;
+
+  name[1] = '\0';
+  for (i = 0; i < MARKS; ++i)
+    if (marks[i] != NPOS)
+      {
+	name[0] = (char) ('a' + i);
+	if (!json_output)
+	  {
+	    printf (G00056, name[0], (unsigned long) marks[i] + 1);
+	    continue;
+	  }
+	if (out == 0)
+	  out = DScreate ();
+	json_begin (out, "mark");
+	json_string (out, "name", name, 1);
+	json_number (out, "line", (unsigned long) marks[i] + 1);
+	json_end (out);
+	fputs (DScstr (out), stdout);
+      }
 }
 
 /* destroy the buffer */
 void
 destroy_buffer (void)
 {
+  if (pieces != 0)
+    {
+      PIECE_destroy (pieces);
+      DAS_destroy (added);
+      pieces = 0;
+      added = 0;
+    }
   DAS_destroy (buffer);
   buffer = 0;
+  ORG_destroy (origin);
+  origin = 0;
+  origin_close ();
+  free (block_state);
+  free (summaries);
+  block_state = 0;
+  summaries = 0;
+  blocks = 0;
 }
 
 /* END OF FILE */
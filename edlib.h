@@ -36,6 +36,11 @@
 #include <sys/types.h>
 #endif
 
+/* macros */
+
+/* how many marks there are, named a to z */
+#define MARKS           26
+
 /* typedefs */
 
 /* static variables */
@@ -50,15 +55,50 @@ int file_exists (char *);
 /* initialize the buffer */
 void create_buffer (void);
 
+/* has the buffer changed since it was loaded or last saved? */
+int buffer_changed (void);
+
+/* the whole buffer has been saved to the file being edited */
+void buffer_saved (void);
+
 /* destroy the buffer */
 void destroy_buffer (void);
 
+/* With on nonzero, the lines deleted, inserted and moved are not taken
+   out of the buffer or put into it straight away; the edits are noted
+   against the lines as they were, and carried out together, in a single
+   pass over the buffer, by commit_edits.  Anything else that needs the
+   lines of the buffer must call commit_edits first.  */
+void defer_edits (int on);
+
+/* carry out the edits that have been deferred, if there are any */
+void commit_edits (void);
+
+/* put mark on line (zero-based); the mark stays with the line as
+   others are inserted, deleted or moved around it, and goes away if
+   the line itself is deleted */
+void set_mark (int mark, unsigned long line);
+
+/* the line mark is on (zero-based), or NPOS if it is not set */
+size_t get_mark (int mark);
+
+/* list the marks that are set */
+void list_marks (void);
+
+/* load_file - read the file being edited into the buffer */
+void load_file (char *filename);
+
 /* transfer_file - merges the contents of a file on disk with a file in memory
  */
 void transfer_file (unsigned long before_line, char *filename);
 
-/* write X number of lines to a file */
-void write_file (unsigned long lines, char *filename);
+/* write X number of lines to a file; returns nonzero if that failed */
+int write_file (unsigned long lines, char *filename);
+
+/* write_block - write lines line1 through line2 to a file, or add them
+   to the end of it, leaving the file being edited alone */
+void write_block (unsigned long line1, unsigned long line2, char *filename,
+                  int append);
 
 /* copy a block of lines elsewhere in the buffer */
 void copy_block (unsigned long line1, unsigned long line2,
@@ -91,6 +131,30 @@ unsigned long replace_buffer (unsigned long current_line,
                               unsigned long line1, unsigned long line2,
                               int verify, char *s);
 
+/* normalize_block - change the case of, or tidy the blanks in, a block
+   of lines; how is one of the NORM_ letters in norm.h */
+unsigned long normalize_block (unsigned long current_line,
+                               unsigned long line1, unsigned long line2,
+                               int how, unsigned tabs);
+
+/* save_session - write the buffer, its marks and the current line to a
+   session file; edited is the name of the file being edited */
+void save_session (char *filename, unsigned long current_line,
+                   char *edited);
+
+/* restore_session - replace the buffer with a saved session; returns
+   the name of the file that was being edited, or a null pointer */
+char *restore_session (char *filename, unsigned long *current_line);
+
+/* search_address - work out the address /text/ or ?text? at *sp,
+   searching forward from the line after line or backward from the
+   line before it (both counting from 1), and move *sp past it; returns
+   the line found (counting from 1), or 0 if there is none */
+unsigned long search_address (char **sp, unsigned long line);
+
+/* search_files - search the files named after a string for it */
+void search_files (char *s);
+
 /* insert_block - go into insert mode */
 unsigned long insert_block (unsigned long line);
 
@@ -32,8 +32,16 @@
 #include <ctype.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include "batch.h"
+#include "cancel.h"
 #include "dynstr.h"
 #include "edlib.h"
+#include "find.h"
+#include "json.h"
+#include "norm.h"
+#include "pool.h"
+#include "query.h"
 #define EXTERN			/* force a declaration */
 #include "msgs.h"
 #ifdef USE_CATGETS
@@ -52,6 +60,14 @@
 #define MAX(x,y) ((x)>(y)?(x):(y))
 #endif
 
+/* where commands come from once a file has been read from the standard
+   input */
+#if defined(__MSDOS__) || defined(_WIN32)
+#define CONSOLE "CON"
+#else
+#define CONSOLE "/dev/tty"
+#endif
+
 /* static variables */
 
 long current_line = 1L;
@@ -59,6 +75,11 @@ unsigned page_size = 23;
 int exiting = 0;
 char *current_filename = 0;
 
+/* In batch mode, files are only written if they have changed.  */
+static int batch_mode = 0;
+static int saves = 0;		/* how many times the file was written */
+static int save_errors = 0;	/* and how many times that failed */
+
 /* functions */
 
 void
@@ -72,11 +93,90 @@ help (void)
   puts (G00018);
   puts (G00019);
   puts (G00020);
+  puts (G00046);
+  puts (G00047);
+  puts (G00069);
+  puts (G00053);
+  puts (G00064);
+  puts (G00065);
+  puts (G00066);
+  puts (G00071);
+  puts (G00057);
   puts (G00021);
   puts (G00022);
   puts (G00023);
 }
 
+/* save_buffer - write lines (or all of them if lines is NPOS) to
+   filename */
+static void
+save_buffer (unsigned long lines, char *filename)
+{
+  int whole = lines == NPOS && current_filename != 0
+    && strcmp (filename, current_filename) == 0;
+
+  commit_edits ();
+  if (whole && batch_mode && !buffer_changed ())
+    return;
+  if (write_file (lines, filename) != 0)
+    save_errors++;
+  else if (whole)
+    {
+      buffer_saved ();
+      saves++;
+    }
+}
+
+/* open_hit - load the file the hit'th line found by f is in, and go
+   to that line */
+static void
+open_hit (unsigned long hit)
+{
+  static STRING_T *name = 0;
+  unsigned long line;
+  char *filename = find_hit (hit, &line);
+
+  if (name == 0)
+    name = DScreate ();
+  DSassigncstr (name, filename, NPOS);
+  current_filename = DScstr (name);
+  destroy_buffer ();
+  create_buffer ();
+  load_file (current_filename);
+  current_line = MIN (line, get_last_line ());
+  if (current_line == 0)
+    current_line = 1;
+  else
+    display_block (current_line - 1, current_line - 1, current_line - 1, 1);
+}
+
+/* resume_session - replace the buffer with the session saved in
+   filename, and go to the line that was current */
+static void
+resume_session (char *filename)
+{
+  static STRING_T *name = 0;
+  unsigned long line;
+  char *edited = restore_session (filename, &line);
+
+  if (edited == 0)
+    return;
+  if (name == 0)
+    name = DScreate ();
+  DSassigncstr (name, edited, NPOS);
+  current_filename = DSlength (name) != 0 ? DScstr (name) : 0;
+  current_line = line != 0 ? line : 1;
+}
+
+/* is_backward - whether the ? at s starts the address ?text? rather
+   than asking for help or for each replacement to be verified */
+static int
+is_backward (char *s)
+{
+  return s[1] != '\0' && strchr ("sSrR", s[1]) == 0
+    && strchr (s + 1, '?') != 0;
+}
+
 void
 parse_command (char *s)
 {
@@ -85,11 +185,15 @@ parse_command (char *s)
   long lp[4] = { 0UL, 0UL, 0UL, 0UL };
   char op = '+';
   int verifying = 0;
-  size_t lpip = 0;
+  int query;
+  int append, range;
+  unsigned long tabs;
+  size_t lpip = 0, mark;
 
   if (*s == '\0')
     return;
-  while (*ip && !isalpha (*ip) && *ip != '?')
+  cancel_clear ();
+  while (*ip && !isalpha (*ip) && (*ip != '?' || is_backward (ip)))
     {
       /* parse the digits */
       if (*ip == '.')
@@ -97,7 +201,7 @@ parse_command (char *s)
 	  if (acc)
 	    {
 	      /* Error: Invalid user input */
-	      fprintf (stderr, G00037, G00033);
+	      json_error ("invalid_input", G00033);
 	      return;
 	    }
 	  acc = current_line;
@@ -108,7 +212,7 @@ parse_command (char *s)
 	  if (acc)
 	    {
 	      /* Error: Invalid user input */
-	      fprintf (stderr, G00037, G00033);
+	      json_error ("invalid_input", G00033);
 	      return;
 	    }
 	  acc = get_last_line ();
@@ -119,19 +223,55 @@ parse_command (char *s)
 	  if (acc)
 	    {
 	      /* Error: Invalid user input */
-	      fprintf (stderr, G00037, G00033);
+	      json_error ("invalid_input", G00033);
 	      return;
 	    }
 	  acc = get_last_line () + 1;
 	  ip++;
 	}
+      else if (*ip == '\'')
+	{
+	  /* the line a mark is on */
+	  if (acc || !islower ((unsigned char) ip[1]))
+	    {
+	      /* Error: Invalid user input */
+	      json_error ("invalid_input", G00033);
+	      return;
+	    }
+	  if ((mark = get_mark (ip[1] - 'a')) == NPOS)
+	    {
+	      json_error ("mark_not_set", G00055);
+	      return;
+	    }
+	  acc = (long) mark + 1;
+	  ip += 2;
+	}
+      else if (*ip == '/' || *ip == '?')
+	{
+	  /* the next line holding some text, looking on from the
+	     address before this one, if any, or the current line */
+	  if (acc)
+	    {
+	      /* Error: Invalid user input */
+	      json_error ("invalid_input", G00033);
+	      return;
+	    }
+	  acc = search_address (&ip, lpip > 0 && lp[lpip - 1] > 0
+				? (unsigned long) lp[lpip - 1]
+				: (unsigned long) current_line);
+	  if (acc == 0)
+	    {
+	      json_puts ("status", "not_found", G00011);
+	      return;
+	    }
+	}
       else
 	while (isdigit (*ip))
 	  acc = acc * 10 + (*ip++ - '0');
       if (lpip >= 4)
 	{
 	  /* Error: Invalid user input */
-	  fprintf (stderr, G00037, G00033);
+	  json_error ("invalid_input", G00033);
 	  return;
 	}
       lp[lpip] += (op == '+') ? acc : -acc;
@@ -148,7 +288,7 @@ parse_command (char *s)
 			|| (*ip == '?' && isalpha ((unsigned char) ip[1]))))
 	{
 	  /* Error: Invalid user input */
-	  fprintf (stderr, G00037, G00033);
+	  json_error ("invalid_input", G00033);
 	  return;
 	}
     }
@@ -157,6 +297,9 @@ parse_command (char *s)
       ip++;
       verifying = 1;
     }
+  /* only deleting, inserting and moving lines can be left until later */
+  if (*ip == '\0' || strchr ("aAdDiImM", *ip) == 0)
+    commit_edits ();
   /* at this point, *ip should be pointing to '\0' or the command character */
   switch (tolower ((unsigned char) (*ip)))
     {
@@ -171,10 +314,28 @@ parse_command (char *s)
       else
 	{
 	  /* Error: Invalid user input */
-	  fprintf (stderr, G00037, G00033);
+	  json_error ("invalid_input", G00033);
 	  return;
 	}
       break;
+    case 'b':			/* background query */
+      if (lp[0] == 0)
+	lp[0] = 1;
+      if (lp[1] == 0)
+	lp[1] = get_last_line ();
+      query = tolower ((unsigned char) ip[1]);
+      if (query != QUERY_COUNT && query != QUERY_CHECKSUM
+	  && query != QUERY_DIFF && query != QUERY_SUM)
+	{
+	  /* Error: Invalid user input */
+	  json_error ("invalid_input", G00033);
+	  return;
+	}
+      ip += 2;
+      while (*ip && isspace (*ip))
+	ip++;
+      query_start (query, lp[0] - 1, lp[1] - 1, ip);
+      break;
     case 'c':			/* copy */
       if (lp[0] == 0)
 	lp[0] = current_line;
@@ -183,7 +344,7 @@ parse_command (char *s)
       if (lp[2] == 0)
 	{
 	  /* Error: Invalid user input */
-	  fprintf (stderr, G00037, G00033);
+	  json_error ("invalid_input", G00033);
 	  return;
 	}
       if (lp[3] == 0)
@@ -204,11 +365,20 @@ parse_command (char *s)
 	{
 	  /* invalid parameters */
 	  /* Error: Invalid user input */
-	  fprintf (stderr, G00037, G00033);
+	  json_error ("invalid_input", G00033);
 	  return;
 	}
       move_block (lp[0] - 1, lp[1] - 1, lp[2] - 1);
       break;
+    case 'k':			/* mark */
+      if (ip[1] == '\0' && lp[0] == 0)
+	list_marks ();
+      else if (!islower ((unsigned char) ip[1]) || ip[2] != '\0')
+	/* Error: Invalid user input */
+	json_error ("invalid_input", G00033);
+      else
+	set_mark (ip[1] - 'a', (lp[0] ? lp[0] : current_line) - 1);
+      break;
     case 'l':			/* list */
     case 'p':			/* print */
       if (lp[0] == 0)
@@ -220,6 +390,25 @@ parse_command (char *s)
 	lp[1] = lp[0] + page_size - 1;
       display_block (lp[0] - 1, lp[1] - 1, current_line - 1, page_size);
       break;
+    case 'n':			/* normalize */
+      if (lp[1] == 0)
+	lp[1] = (lp[0]) ? lp[0] : current_line;
+      if (lp[0] == 0)
+	lp[0] = current_line;
+      query = tolower ((unsigned char) ip[1]);
+      tabs = query != 0 && isdigit ((unsigned char) ip[2])
+	? strtoul (ip + 2, 0, 10) : 8;
+      if ((query != NORM_UPPER && query != NORM_LOWER && query != NORM_TRIM
+	   && query != NORM_EXPAND && query != NORM_COLLAPSE)
+	  || tabs == 0 || (unsigned) tabs != tabs)
+	{
+	  /* Error: Invalid user input */
+	  json_error ("invalid_input", G00033);
+	  return;
+	}
+      current_line = normalize_block (current_line, lp[0] - 1, lp[1] - 1,
+				      query, (unsigned) tabs);
+      break;
     case 'q':			/* quit */
       exiting = quitting ();
       break;
@@ -235,14 +424,58 @@ parse_command (char *s)
     case 'e':			/* write & exit */
     case 'w':			/* write file */
       exiting = (*ip == 'e') && quitting ();
-      ip++;
+      append = *ip == 'w' && ip[1] == '>' && ip[2] == '>';
+      range = *ip == 'w' && (lp[1] != 0 || append);
+      ip += append ? 3 : 1;
       while (*ip && isspace (*ip))
 	ip++;
-      if (*ip == 0 && current_filename == 0)
+      if (*ip == 0 && (current_filename == 0 || range))
 	/* No filename */
-	fprintf (stderr, G00037, G00034);
+	json_error ("no_filename", G00034);
+      else if (range)
+	{
+	  /* a range of lines goes to a file of its own */
+	  if (lp[1] == 0)
+	    {
+	      lp[1] = lp[0] ? lp[0] : (long) get_last_line ();
+	      lp[0] = 1;
+	    }
+	  write_block (lp[0] - 1, lp[1] - 1, ip, append);
+	}
       else
-	write_file (lp[0] ? lp[0] : NPOS, *ip ? ip : current_filename);
+	save_buffer (lp[0] ? (size_t) lp[0] : NPOS,
+		     *ip ? ip : current_filename);
+      break;
+    case 'f':			/* find in files */
+      search_files (ip + 1);
+      break;
+    case 'g':			/* go to a line found by f */
+      if (lp[0] == 0)
+	find_list ();
+      else if (lp[0] < 0 || (unsigned long) lp[0] > find_count ())
+	/* Error: Invalid user input */
+	json_error ("invalid_input", G00033);
+      else if (!buffer_changed () || quitting ())
+	open_hit (lp[0] - 1);
+      break;
+    case 'z':			/* save or resume a session */
+      query = tolower ((unsigned char) ip[1]);
+      if (query != 'w' && query != 'r')
+	{
+	  /* Error: Invalid user input */
+	  json_error ("invalid_input", G00033);
+	  return;
+	}
+      ip += 2;
+      while (*ip && isspace (*ip))
+	ip++;
+      if (*ip == 0)
+	/* No filename */
+	json_error ("no_filename", G00034);
+      else if (query == 'w')
+	save_session (ip, current_line, current_filename);
+      else if (!buffer_changed () || quitting ())
+	resume_session (ip);
       break;
     case 'i':			/* insert */
       if (lp[0] == 0)
@@ -270,11 +503,40 @@ parse_command (char *s)
       break;
     default:
       /* Invalid user input */
-      fprintf (stderr, G00037, G00033);
+      json_error ("invalid_input", G00033);
       break;
     }
 }
 
+/* edit_file - edit a file for batch mode, with the commands on the
+   standard input.  Running out of commands saves the file, as e does;
+   q leaves it as it was.  */
+static int
+edit_file (char *filename)
+{
+  char *s;
+  int status;
+
+  if (!file_exists (filename))
+    return BATCH_FAILED;
+  current_filename = filename;
+  current_line = 1L;
+  exiting = 0;
+  saves = save_errors = 0;
+  create_buffer ();
+  load_file (filename);
+  while (!exiting && (s = read_line ("*")) != 0)
+    parse_command (s);
+  if (!exiting)
+    save_buffer (NPOS, filename);
+  query_finish ();
+  destroy_buffer ();
+  current_filename = 0;
+  status = save_errors ? BATCH_FAILED : saves ? BATCH_WRITTEN
+    : BATCH_UNCHANGED;
+  return status;
+}
+
 /* Main function for edlin.  */
 int
 main (int argc, char **argv)
@@ -286,20 +548,62 @@ main (int argc, char **argv)
   the_cat = catopen ("edlin", 0);
 #endif
 
+  /* edlin -j ... puts out JSON, and edlin -t ... defers edits */
+  while (argc >= 2 && (strcmp (argv[1], "-j") == 0
+		       || strcmp (argv[1], "-t") == 0))
+    {
+      if (argv[1][1] == 'j')
+	json_output = 1;
+      else
+	defer_edits (1);
+      argc--;
+      argv++;
+    }
+
+  /* edlin -b script file... runs the script over the files */
+  if (argc >= 3 && strcmp (argv[1], "-b") == 0)
+    {
+      unsigned long failed;
+
+      pool_init (0);
+      batch_mode = 1;
+      failed = batch_run (argv[2], argc - 3, argv + 3, edit_file);
+      pool_destroy ();
+#if defined(USE_CATGETS) || defined(USE_KITTEN)
+      catclose (the_cat);
+#endif
+      return failed != 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+
   /* put out the copyright notice and disclaimer */
-  fputs (PACKAGE_NAME " " PACKAGE_VERSION, stdout);
-  puts (G00024);
-  puts (G00025);
-  puts (G00026);
-  puts (G00027);
-  puts (G00028);
-  puts (G00029);
+  if (!json_output)
+    {
+      fputs (PACKAGE_NAME " " PACKAGE_VERSION, stdout);
+      puts (G00024);
+      puts (G00025);
+      puts (G00026);
+      puts (G00027);
+      puts (G00028);
+      puts (G00029);
+    }
+  pool_init (0);
+  cancel_init ();
   create_buffer ();
   if (argc >= 2)
     {
       current_filename = argv[1];
-      if (file_exists (current_filename))
-	transfer_file (0, current_filename);
+      if (strcmp (current_filename, "-") == 0)
+	{
+	  /* the standard input is the file; take commands from the console */
+	  transfer_file (0, current_filename);
+	  current_filename = 0;
+	  if (freopen (CONSOLE, "r", stdin) == 0)
+	    perror (CONSOLE);
+	}
+      else if (file_exists (current_filename))
+	load_file (current_filename);
+      else if (json_output)
+	json_record ("new_file", 0, current_filename);
       else
 	{
 	  fputs (current_filename, stdout);
@@ -310,12 +614,15 @@ main (int argc, char **argv)
     }
   while (!exiting)
     {
+      query_poll ();
       s = read_line ("*");
       if (s == 0)
 	abort ();
       parse_command (s);
     }
+  query_finish ();
   destroy_buffer ();
+  pool_destroy ();
 #if defined(USE_CATGETS) || defined(USE_KITTEN)
   /* close catalog */
   catclose (the_cat);
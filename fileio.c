@@ -0,0 +1,1200 @@
+/* fileio.c -- reading and writing whole files for edlin
+
+  DESCRIPTION:
+
+  This file contains the routines that move whole files between the
+  disk and arrays of lines.
+
+  A file is read in large chunks rather than a line at a time.  Where
+  there are threads, reading and splitting are pipelined: a reader task
+  started through the worker pool fills a ring of eight chunks (of a
+  megabyte each) while the calling thread splits the chunks it has been
+  handed into lines, so a slow pipe or FIFO keeps delivering data while
+  the lines already read are being built.  The reader and the splitter
+  only ever touch their own end of the ring; the ring indices are
+  published with release and acquire ordering, and the two sides sleep
+  on a pool event only when the ring is full or empty.
+
+  Output goes the other way through a ring of two buffers: commands
+  format into one buffer while a writer task drains the other, so a
+  slow terminal, pipe or disk only holds a command up once both
+  buffers are full.
+
+  Regular files bypass stdio.  The reader and writer stages then keep
+  several whole chunks in flight at once through io_uring where the
+  kernel offers it, and otherwise move one chunk at a time with pread()
+  and pwrite().  Runs of lines that a save has not changed since they
+  were read are copied from the original file with copy_file_range(),
+  which on file systems that share blocks between files costs next to
+  nothing.  Reads are announced to the kernel ahead of time, and on
+  request the pages a load or save has finished with are dropped from
+  the page cache, or a save skips the page cache with O_DIRECT, so that
+  one huge file does not push everything else out of memory.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+/* includes */
+
+#include "config.h"
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_STDATOMIC_H
+#include <stdatomic.h>
+#endif
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>		/* need pread, pwrite */
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>		/* need posix_fadvise, O_DIRECT */
+#endif
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#endif
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>		/* need FICLONE */
+#endif
+#include "cancel.h"
+#include "dynstr.h"
+#include "fileio.h"
+#include "pool.h"
+#include "uring.h"
+#include "zio.h"
+
+/* macros */
+
+/* How much is read or written at a time.  */
+#if INT_MAX > 32767
+#define LOAD_CHUNK	((size_t) 1 << 20)
+#define WRITE_CHUNK	((size_t) 1 << 18)
+#else
+#define LOAD_CHUNK	((size_t) 1 << 13)
+#define WRITE_CHUNK	((size_t) 1 << 13)
+#endif
+
+#if defined(HAVE_PTHREAD_H) && defined(HAVE_STDATOMIC_H)
+#define FIO_THREADS
+#if defined(HAVE_PREAD) && defined(HAVE_PWRITE) && defined(HAVE_SYS_STAT_H)
+#define FIO_FD			/* regular files can bypass stdio */
+#endif
+#endif
+
+#if defined(HAVE_UNISTD_H) && defined(HAVE_FCNTL_H) && defined(HAVE_SYS_STAT_H)
+#define FIO_STAT		/* files can be looked at and copied by name */
+#endif
+
+/* chunks in flight between the stages: loads keep more of them, so
+   that io_uring has several reads to work on at once */
+#define LOAD_SLOTS	8
+#define WRITE_SLOTS	2
+#define SAVE_SLOTS	4
+#define RING_MAX	8
+
+/* ways of getting at regular files */
+#define IO_STDIO	0
+#define IO_PREAD	1
+#define IO_URING	2
+
+/* what to do with the page cache */
+#define CACHE_KEEP	0
+#define CACHE_DROP	1	/* drop pages once they are done with */
+#define CACHE_DIRECT	2	/* and write saves around the cache */
+
+/* how fio_backup may copy a file */
+#define BACKUP_RENAME	0	/* not at all */
+#define BACKUP_CLONE	1	/* by sharing its blocks */
+#define BACKUP_COPY	2	/* or else inside the kernel */
+
+/* the most copy_file_range is asked to copy at once */
+#define COPY_STEP	((size_t) 1 << 30)
+
+/* O_DIRECT needs buffers, offsets and lengths lined up to this */
+#define DIRECT_ALIGN	4096
+
+/* typedefs */
+
+/* What the splitter builds.  */
+typedef struct LOADER
+{
+  DAS_ARRAY_T *lines;
+  ORG_ARRAY_T *origins;		/* or a null pointer */
+  STRING_T *partial;		/* the start of a line that runs on into
+				   the next chunk */
+  off_t start;			/* where partial starts */
+  off_t pos;			/* where the next chunk starts */
+  DSSEG *seg;			/* where the lines are being put, if
+				   anywhere */
+} LOADER;
+
+/* The chunks passed from one stage to the next.  Chunk i lives in slot
+   i % slots.  head is the number of chunks the producer has filled, tail
+   the number the consumer has finished with.  Each side only writes its
+   own index.  When reading, a chunk shorter than LOAD_CHUNK is the last
+   one; when writing, an empty chunk is.  */
+typedef struct RING
+{
+  FILE *f;
+  unsigned slots;
+  char *chunk[RING_MAX];
+  size_t len[RING_MAX];
+  int error;
+#ifdef FIO_THREADS
+  atomic_size_t head;
+  atomic_size_t tail;
+#endif
+  POOL_EVENT *event;
+  POOL_TASK *task;
+  ZIO *z;			/* the compressed stream, if it is one */
+#ifdef FIO_FD
+  int fd;			/* -1 if going through f */
+  off_t base;			/* where in the file the first chunk goes */
+  off_t size;			/* where reading stops */
+  URING *uring;
+  int done[RING_MAX];		/* has the I/O on a slot finished? */
+  int src[RING_MAX];		/* a file to copy from instead, or -1 */
+  off_t from[RING_MAX];		/* where in src to copy from */
+  int drop;			/* drop finished pages from the cache? */
+  int direct;			/* is O_DIRECT set on fd? */
+  off_t dropped;		/* pages before this have been dropped */
+#endif
+} RING;
+
+struct FIO_WRITER
+{
+  RING r;
+  char *fill;			/* the chunk being filled */
+  size_t len;			/* how much of it is full */
+};
+
+/* Invoke "dynarray.h" to get us arrays of offsets. */
+#define T               off_t
+#define TS              ORG
+#define Tassign(x,y)    (*(x) = *(y))
+#define Tctor(x)        (*(x) = 0)
+#define Tdtor(x)
+#define Trelocatable
+#undef  Tstorage_class
+#undef  PROTOS_ONLY
+#include "dynarray.h"
+#undef  T
+#undef  TS
+#undef  Tassign
+#undef  Tctor
+#undef  Tdtor
+#undef  Trelocatable
+
+/* functions */
+
+/* add_line - append n characters at s to the lines as a new line that
+   was found at offset at.  The lines go one after another into
+   segments, where they can be; one that does not fit in what is left
+   of a segment starts a new one.  */
+static void
+add_line (LOADER * ld, char *s, size_t n, off_t at)
+{
+  static STRING_T empty;
+  STRING_T *ds;
+
+  DAS_append (ld->lines, &empty, 1, 1);
+  ds = DAS_get_at (ld->lines, DAS_length (ld->lines) - 1);
+  if (ld->seg == 0 || !DSassign_seg (ds, ld->seg, s, n))
+    {
+      DSseg_close (ld->seg);
+      if ((ld->seg = DSseg_create ()) == 0
+	  || !DSassign_seg (ds, ld->seg, s, n))
+	DSassigncstr (ds, s, n);
+    }
+  if (ld->origins != 0)
+    ORG_append (ld->origins, &at, 1, 1);
+}
+
+/* split_chunk - split n characters at s into lines */
+static void
+split_chunk (LOADER * ld, char *s, size_t n)
+{
+  char *b = s, *e = s + n, *nl;
+
+  while ((nl = memchr (s, '\n', e - s)) != 0)
+    {
+      if (DSlength (ld->partial) != 0)
+	{
+	  DSappendcstr (ld->partial, s, nl - s);
+	  add_line (ld, DScstr (ld->partial), DSlength (ld->partial),
+		    ld->start);
+	  DSresize (ld->partial, 0, 0);
+	}
+      else
+	add_line (ld, s, nl - s, ld->pos + (s - b));
+      s = nl + 1;
+    }
+  if (s < e)
+    {
+      if (DSlength (ld->partial) == 0)
+	ld->start = ld->pos + (s - b);
+      DSappendcstr (ld->partial, s, e - s);
+    }
+  ld->pos += n;
+  progress_at ((unsigned long) ld->pos);
+}
+
+/* chunk_alloc - allocate a chunk lined up well enough for O_DIRECT */
+static char *
+chunk_alloc (size_t size)
+{
+  void *p;
+
+#ifdef HAVE_POSIX_MEMALIGN
+  if (posix_memalign (&p, DIRECT_ALIGN, size) != 0)
+    p = 0;
+#else
+  p = malloc (size);
+#endif
+  if (p == 0)
+    Nomemory ();
+  return p;
+}
+
+/* ring_create, ring_destroy - set up and throw away the chunks of a ring */
+static void
+ring_create (RING * r, FILE * f, unsigned slots, size_t size)
+{
+  unsigned i;
+
+  r->f = f;
+  r->slots = slots;
+  r->error = 0;
+#ifdef FIO_THREADS
+  atomic_init (&r->head, 0);
+  atomic_init (&r->tail, 0);
+#endif
+  for (i = 0; i < slots; ++i)
+    r->chunk[i] = chunk_alloc (size);
+  r->event = 0;
+  r->task = 0;
+  r->z = 0;
+#ifdef FIO_FD
+  r->fd = -1;
+  r->uring = 0;
+  r->drop = 0;
+  r->direct = 0;
+#endif
+}
+
+static void
+ring_destroy (RING * r)
+{
+  unsigned i;
+
+  pool_event_destroy (r->event);
+#ifdef FIO_FD
+  uring_destroy (r->uring);
+#endif
+  for (i = 0; i < r->slots; ++i)
+    free (r->chunk[i]);
+}
+
+/* ring_read - read up to n bytes into s, decompressing them if need be;
+   returns how many were read */
+static size_t
+ring_read (RING * r, char *s, size_t n)
+{
+  size_t m;
+
+  if (r->z != 0)
+    return zio_read (r->z, s, n);
+  m = fread (s, 1, n, r->f);
+  if (m < n && ferror (r->f))
+    r->error = 1;
+  return m;
+}
+
+/* ring_write - write n bytes from s, compressing them if need be */
+static void
+ring_write (RING * r, char *s, size_t n)
+{
+  if (r->z != 0)
+    zio_write (r->z, s, n);
+  else if (fwrite (s, 1, n, r->f) != n)
+    r->error = 1;
+}
+
+#ifdef FIO_THREADS
+
+/* ring_has_room, ring_has_chunk, ring_is_empty - what the stages wait
+   for */
+static int
+ring_has_room (void *arg)
+{
+  RING *r = arg;
+
+  return atomic_load_explicit (&r->head, memory_order_relaxed)
+    - atomic_load_explicit (&r->tail, memory_order_acquire) < r->slots;
+}
+
+static int
+ring_has_chunk (void *arg)
+{
+  RING *r = arg;
+
+  return atomic_load_explicit (&r->head, memory_order_acquire)
+    != atomic_load_explicit (&r->tail, memory_order_relaxed);
+}
+
+static int
+ring_is_empty (void *arg)
+{
+  RING *r = arg;
+
+  return atomic_load_explicit (&r->tail, memory_order_acquire)
+    == atomic_load_explicit (&r->head, memory_order_relaxed);
+}
+
+/* ring_put - the producer has filled the chunk at head with n bytes */
+static void
+ring_put (RING * r, size_t n)
+{
+  size_t head = atomic_load_explicit (&r->head, memory_order_relaxed);
+
+  r->len[head % r->slots] = n;
+  atomic_store_explicit (&r->head, head + 1, memory_order_release);
+  pool_event_signal (r->event);
+}
+
+/* ring_take - the consumer has finished with the chunk at tail */
+static void
+ring_take (RING * r)
+{
+  size_t tail = atomic_load_explicit (&r->tail, memory_order_relaxed);
+
+  atomic_store_explicit (&r->tail, tail + 1, memory_order_release);
+  pool_event_signal (r->event);
+}
+
+/* ring_head, ring_tail - the slot each side works on next */
+#define ring_head(r)	(atomic_load_explicit (&(r)->head, memory_order_relaxed) \
+			 % (r)->slots)
+#define ring_tail(r)	(atomic_load_explicit (&(r)->tail, memory_order_relaxed) \
+			 % (r)->slots)
+
+#ifdef FIO_FD
+
+/* io_backend - how regular files are read and written; FIO_ENV can
+   turn io_uring or the whole bypass off */
+static int
+io_backend (void)
+{
+  static int backend = -1;
+  char *s;
+
+  if (backend < 0)
+    {
+      s = getenv (FIO_ENV);
+      if (s != 0 && strcmp (s, "stdio") == 0)
+	backend = IO_STDIO;
+      else if (s != 0 && strcmp (s, "pread") == 0)
+	backend = IO_PREAD;
+      else
+	backend = IO_URING;
+    }
+  return backend;
+}
+
+/* cache_policy - what FIO_CACHE_ENV says to do with the page cache */
+static int
+cache_policy (void)
+{
+  static int policy = -1;
+  char *s;
+
+  if (policy < 0)
+    {
+      s = getenv (FIO_CACHE_ENV);
+      if (s != 0 && strcmp (s, "drop") == 0)
+	policy = CACHE_DROP;
+      else if (s != 0 && strcmp (s, "direct") == 0)
+	policy = CACHE_DIRECT;
+      else
+	policy = CACHE_KEEP;
+    }
+  return policy;
+}
+
+/* set_direct - turn O_DIRECT on fd on or off; returns nonzero if it
+   is on afterwards */
+static int
+set_direct (int fd, int on)
+{
+#ifdef O_DIRECT
+  int flags = fcntl (fd, F_GETFL);
+
+  if (flags == -1)
+    return 0;
+  flags = on ? flags | O_DIRECT : flags & ~O_DIRECT;
+  return fcntl (fd, F_SETFL, flags) == 0 && on;
+#else
+  return 0;
+#endif
+}
+
+#ifdef HAVE_POSIX_FADVISE
+/* advise - pass a hint about part of the file on to the kernel */
+static void
+advise (RING * r, off_t off, off_t n, int advice)
+{
+  posix_fadvise (r->fd, off, n, advice);
+}
+#endif
+
+/* ring_open - set r up to go straight to the file behind f if it is a
+   regular file, starting where f is now */
+static void
+ring_open (RING * r, FILE * f, int write)
+{
+  struct stat st;
+  unsigned i;
+  int fd;
+
+  if (io_backend () == IO_STDIO || fflush (f) != 0
+      || fstat (fd = fileno (f), &st) != 0 || !S_ISREG (st.st_mode)
+      || (r->base = lseek (fd, 0, SEEK_CUR)) < 0)
+    return;
+  r->fd = fd;
+  r->size = st.st_size;
+  r->dropped = r->base;
+  r->drop = cache_policy () != CACHE_KEEP;
+#ifdef HAVE_POSIX_FADVISE
+  if (!write)
+    advise (r, r->base, 0, POSIX_FADV_SEQUENTIAL);
+#endif
+  if (write && cache_policy () == CACHE_DIRECT
+      && r->base % DIRECT_ALIGN == 0)
+    {
+      for (i = 0; i < r->slots; ++i)
+	if ((unsigned long) r->chunk[i] % DIRECT_ALIGN != 0)
+	  break;
+      if (i == r->slots)
+	r->direct = set_direct (fd, 1);
+    }
+  if (io_backend () == IO_URING)
+    r->uring = uring_create (r->chunk, r->slots,
+			     write ? WRITE_CHUNK : LOAD_CHUNK);
+}
+
+/* ring_close - undo what ring_open did to the file */
+static void
+ring_close (RING * r)
+{
+  if (r->direct)
+    r->direct = set_direct (r->fd, 0);
+}
+
+/* read_ahead - ask for the chunk after the ones being read to be on its
+   way into the cache by the time it is wanted */
+static void
+read_ahead (RING * r, off_t off)
+{
+#ifdef HAVE_POSIX_FADVISE
+  if (off < r->size)
+    advise (r, off, LOAD_CHUNK, POSIX_FADV_WILLNEED);
+#endif
+}
+
+/* read_done - a chunk has been read into memory, so its pages can go */
+static void
+read_done (RING * r, off_t off, size_t n)
+{
+#ifdef HAVE_POSIX_FADVISE
+  if (r->drop && n != 0)
+    advise (r, off, n, POSIX_FADV_DONTNEED);
+#endif
+}
+
+/* write_done - a chunk has been written.  Start writing it back to the
+   disk, then wait for the chunks before it to be written back so that
+   their pages are clean and can be dropped.  */
+static void
+write_done (RING * r, off_t off, size_t n)
+{
+  if (!r->drop)
+    return;
+#ifdef HAVE_SYNC_FILE_RANGE
+  sync_file_range (r->fd, off, n, SYNC_FILE_RANGE_WRITE);
+  if (r->dropped < off)
+    sync_file_range (r->fd, r->dropped, off - r->dropped,
+		     SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE
+		     | SYNC_FILE_RANGE_WAIT_AFTER);
+#endif
+#ifdef HAVE_POSIX_FADVISE
+  if (r->dropped < off)
+    advise (r, r->dropped, off - r->dropped, POSIX_FADV_DONTNEED);
+#endif
+  r->dropped = off;
+}
+
+/* read_at, write_at - move n bytes between s and offset off of the file
+   one request at a time; read_at returns how many bytes it got */
+static size_t
+read_at (RING * r, char *s, size_t n, off_t off)
+{
+  size_t got = 0;
+  ssize_t m;
+
+  while (got < n && (m = pread (r->fd, s + got, n - got, off + got)) != 0)
+    if (m > 0)
+      got += m;
+    else
+      {
+	r->error = 1;
+	break;
+      }
+  return got;
+}
+
+static void
+write_at (RING * r, char *s, size_t n, off_t off)
+{
+  ssize_t m;
+
+  while (n != 0)
+    if ((m = pwrite (r->fd, s, n, off)) > 0)
+      {
+	s += m;
+	n -= m;
+	off += m;
+      }
+    else if (r->direct)
+      /* the file system would not take it straight; go through the
+         cache after all */
+      r->direct = set_direct (r->fd, 0);
+    else
+      {
+	r->error = 1;
+	break;
+      }
+}
+
+/* copy_span - copy what slot describes to offset to of the file.  What
+   the kernel will not copy is read into the slot's chunk and written
+   out from there.  An interrupt leaves the copy unfinished, which counts
+   as an error.  */
+static void
+copy_span (RING * r, unsigned slot, off_t to)
+{
+  off_t from = r->from[slot];
+  size_t n = r->len[slot];
+  ssize_t m;
+
+#ifdef HAVE_COPY_FILE_RANGE
+  while (n != 0 && !cancelled ()
+	 && (m = copy_file_range (r->src[slot], &from, r->fd, &to,
+				  n < COPY_STEP ? n : COPY_STEP, 0)) > 0)
+    n -= m;
+#endif
+  while (n != 0)
+    {
+      if (cancelled ())
+	{
+	  r->error = 1;
+	  break;
+	}
+      m = pread (r->src[slot], r->chunk[slot],
+		 n < WRITE_CHUNK ? n : WRITE_CHUNK, from);
+      if (m <= 0)
+	{
+	  r->error = 1;
+	  break;
+	}
+      write_at (r, r->chunk[slot], m, to);
+      from += m;
+      to += m;
+      n -= m;
+    }
+}
+
+/* finish_at - a request started with uring_start on slot has come back
+   with res; do whatever it left undone the slow way */
+static size_t
+finish_at (RING * r, int write, unsigned slot, size_t n, off_t off,
+	   long res)
+{
+  size_t done = res < 0 ? 0 : (size_t) res;
+
+  if (write)
+    {
+      if (done < n)
+	write_at (r, r->chunk[slot] + done, n - done, off + done);
+      return n;
+    }
+  if (done < n && res != 0)
+    done += read_at (r, r->chunk[slot] + done, n - done, off + done);
+  return done;
+}
+
+/* read_file_chunks - the reader stage for a regular file.  Every free
+   slot gets a read started on it, and finished chunks are handed on in
+   file order.  */
+static void
+read_file_chunks (void *arg)
+{
+  RING *r = arg;
+  size_t issued = 0, head = 0, want[RING_MAX], n;
+  size_t nchunks = (size_t) ((r->size - r->base) / LOAD_CHUNK) + 1;
+  unsigned slot, inflight = 0;
+  off_t off, at[RING_MAX];
+  long res;
+
+  if (r->size < r->base)
+    nchunks = 1;
+  for (;;)
+    {
+      if (cancelled () && head == issued && inflight == 0)
+	{
+	  /* stop early, with an empty chunk to say so */
+	  pool_event_wait (r->event, ring_has_room, r);
+	  ring_put (r, 0);
+	  return;
+	}
+      while (issued < nchunks && !cancelled ()
+	     && issued - atomic_load_explicit (&r->tail, memory_order_acquire)
+	     < r->slots)
+	{
+	  slot = issued % r->slots;
+	  at[slot] = off = r->base + (off_t) issued * LOAD_CHUNK;
+	  if (r->uring == 0)
+	    read_ahead (r, off + (off_t) r->slots * LOAD_CHUNK);
+	  want[slot] = r->size - off < (off_t) LOAD_CHUNK
+	    ? (r->size > off ? (size_t) (r->size - off) : 0) : LOAD_CHUNK;
+	  r->done[slot] = 1;
+	  if (want[slot] == 0)
+	    r->len[slot] = 0;
+	  else if (r->uring == 0
+		   || uring_start (r->uring, r->fd, 0, slot, want[slot], off))
+	    r->len[slot] = read_at (r, r->chunk[slot], want[slot], off);
+	  else
+	    {
+	      r->done[slot] = 0;
+	      ++inflight;
+	    }
+	  ++issued;
+	}
+      while (head < issued && r->done[head % r->slots])
+	{
+	  n = r->len[head % r->slots];
+	  read_done (r, at[head % r->slots], n);
+	  ring_put (r, n);
+	  ++head;
+	  if (n < LOAD_CHUNK)
+	    {
+	      /* the end (or a file that shrank); let the rest drain */
+	      while (inflight != 0)
+		{
+		  uring_wait (r->uring, &res);
+		  --inflight;
+		}
+	      return;
+	    }
+	}
+      if (inflight != 0)
+	{
+	  slot = uring_wait (r->uring, &res);
+	  --inflight;
+	  r->len[slot] = finish_at (r, 0, slot, want[slot], at[slot], res);
+	  r->done[slot] = 1;
+	}
+      else
+	pool_event_wait (r->event, ring_has_room, r);
+    }
+}
+
+/* write_file_chunks - the writer stage for a regular file.  Every chunk
+   handed over gets its write started at once; slots are given back in
+   order as the writes finish.  */
+static void
+write_file_chunks (void *arg)
+{
+  RING *r = arg;
+  size_t issued = 0, tail = 0;
+  off_t off = r->base, at[RING_MAX];
+  unsigned slot, inflight = 0;
+  int last = 0;
+  long res;
+
+  for (;;)
+    {
+      while (!last
+	     && issued != atomic_load_explicit (&r->head, memory_order_acquire))
+	{
+	  slot = issued % r->slots;
+	  at[slot] = off;
+	  r->done[slot] = 1;
+	  if (r->direct && (r->src[slot] >= 0
+			    || r->len[slot] % DIRECT_ALIGN != 0))
+	    r->direct = set_direct (r->fd, 0);	/* the short last chunk */
+	  if (r->len[slot] == 0)
+	    last = 1;
+	  else if (r->src[slot] >= 0)
+	    copy_span (r, slot, off);
+	  else if (r->uring == 0
+		   || uring_start (r->uring, r->fd, 1, slot, r->len[slot], off))
+	    write_at (r, r->chunk[slot], r->len[slot], off);
+	  else
+	    {
+	      r->done[slot] = 0;
+	      ++inflight;
+	    }
+	  off += r->len[slot];
+	  ++issued;
+	}
+      while (tail < issued && r->done[tail % r->slots])
+	{
+	  write_done (r, at[tail % r->slots], r->len[tail % r->slots]);
+	  ring_take (r);
+	  ++tail;
+	}
+      if (last && tail == issued)
+	break;
+      if (inflight != 0)
+	{
+	  slot = uring_wait (r->uring, &res);
+	  --inflight;
+	  finish_at (r, 1, slot, r->len[slot], at[slot], res);
+	  r->done[slot] = 1;
+	}
+      else
+	pool_event_wait (r->event, ring_has_chunk, r);
+    }
+  write_done (r, off, 0);
+  ring_close (r);
+  /* leave the file position where stdio would have left it */
+  lseek (r->fd, off, SEEK_SET);
+}
+
+#endif /* FIO_FD */
+
+/* read_chunks - the reader stage */
+static void
+read_chunks (void *arg)
+{
+  RING *r = arg;
+  size_t n;
+
+  do
+    {
+      pool_event_wait (r->event, ring_has_room, r);
+      n = cancelled () ? 0 : ring_read (r, r->chunk[ring_head (r)],
+					LOAD_CHUNK);
+      ring_put (r, n);
+    }
+  while (n == LOAD_CHUNK);
+}
+
+/* load_pipelined - read f on a helper task while splitting it here;
+   returns -1 if no helper could be started */
+static int
+load_pipelined (FILE * f, ZIO * z, LOADER * ld)
+{
+  RING r;
+  size_t slot, n;
+
+  if (pool_size () < 2)
+    return -1;
+  ring_create (&r, f, LOAD_SLOTS, LOAD_CHUNK);
+  r.event = pool_event_create ();
+  r.z = z;
+#ifdef FIO_FD
+  if (z == 0)
+    ring_open (&r, f, 0);
+  if (r.fd >= 0)
+    r.task = pool_spawn (read_file_chunks, &r);
+  else
+#endif
+    r.task = pool_spawn (read_chunks, &r);
+  if (r.task != 0)
+    {
+      do
+	{
+	  pool_event_wait (r.event, ring_has_chunk, &r);
+	  slot = ring_tail (&r);
+	  n = r.len[slot];
+	  split_chunk (ld, r.chunk[slot], n);
+	  ring_take (&r);
+	}
+      while (n == LOAD_CHUNK);
+      pool_join (r.task);
+    }
+  ring_destroy (&r);
+  return r.task == 0 ? -1 : r.error;
+}
+
+/* write_chunks - the writer stage */
+static void
+write_chunks (void *arg)
+{
+  RING *r = arg;
+  size_t slot, n;
+
+  do
+    {
+      pool_event_wait (r->event, ring_has_chunk, r);
+      slot = ring_tail (r);
+      n = r->len[slot];
+      if (n != 0)
+	{
+	  ring_write (r, r->chunk[slot], n);
+	  if (r->z == 0 && fflush (r->f) != 0)
+	    r->error = 1;
+	}
+      ring_take (r);
+    }
+  while (n != 0);
+}
+
+#endif /* FIO_THREADS */
+
+/* load_serial - read and split f in turn */
+static int
+load_serial (FILE * f, ZIO * z, LOADER * ld)
+{
+  RING r;
+  size_t n;
+
+  ring_create (&r, f, 1, LOAD_CHUNK);
+  r.z = z;
+  do
+    {
+      n = ring_read (&r, r.chunk[0], LOAD_CHUNK);
+      split_chunk (ld, r.chunk[0], n);
+    }
+  while (n == LOAD_CHUNK && !cancelled ());
+  ring_destroy (&r);
+  return r.error;
+}
+
+/* fio_load - read f to the end and append its lines to lines */
+int
+fio_load (FILE * f, int format, DAS_ARRAY_T * lines, ORG_ARRAY_T * origins)
+{
+  LOADER ld;
+  ZIO *z = format != ZIO_PLAIN ? zio_open (f, format, 0) : 0;
+  int r = -1;
+#ifdef HAVE_SYS_STAT_H
+  struct stat st;
+
+  /* how much there is to read is only known for a plain file */
+  if (z == 0 && fstat (fileno (f), &st) == 0 && S_ISREG (st.st_mode))
+    progress_start (PROGRESS_BYTES, 0, (unsigned long) st.st_size);
+  else
+#endif
+    progress_start (PROGRESS_BYTES, 0, 0);
+
+  ld.lines = lines;
+  ld.origins = origins;
+  ld.partial = DScreate ();
+  ld.pos = 0;
+  ld.seg = 0;
+#ifdef FIO_THREADS
+  r = load_pipelined (f, z, &ld);
+#endif
+  if (r < 0)
+    r = load_serial (f, z, &ld);
+  if (z != 0 && zio_close (z) != 0)
+    r = 1;
+  /* the last line need not end with a newline, but then the file does
+     not hold it the way it would be written */
+  if (DSlength (ld.partial) != 0)
+    add_line (&ld, DScstr (ld.partial), DSlength (ld.partial), FIO_NOWHERE);
+  DSdestroy (ld.partial);
+  DSseg_close (ld.seg);
+  progress_end ();
+  return r;
+}
+
+#ifdef FIO_THREADS
+/* put_chunk - pass the slot at head on to the writer stage, holding n
+   bytes of data (src < 0) or saying to copy n bytes at offset from of
+   the file src, and move on to the next slot */
+static void
+put_chunk (FIO_WRITER * w, int src, off_t from, size_t n)
+{
+#ifdef FIO_FD
+  w->r.src[ring_head (&w->r)] = src;
+  w->r.from[ring_head (&w->r)] = from;
+#endif
+  ring_put (&w->r, n);
+  pool_event_wait (w->r.event, ring_has_room, &w->r);
+  w->fill = w->r.chunk[ring_head (&w->r)];
+  w->len = 0;
+}
+#endif
+
+/* hand_over - pass the chunk being filled on to be written */
+static void
+hand_over (FIO_WRITER * w)
+{
+#ifdef FIO_THREADS
+  if (w->r.task != 0)
+    {
+      put_chunk (w, -1, 0, w->len);
+      return;
+    }
+#endif
+  if (w->len != 0)
+    ring_write (&w->r, w->fill, w->len);
+  w->len = 0;
+}
+
+/* fio_writer - start writing to f */
+FIO_WRITER *
+fio_writer (FILE * f, int mode, int format)
+{
+  FIO_WRITER *w;
+  ZIO *z = format != ZIO_PLAIN ? zio_open (f, format, 1) : 0;
+
+  if ((w = malloc (sizeof (FIO_WRITER))) == 0)
+    Nomemory ();
+#ifdef FIO_THREADS
+  if (pool_size () >= 2)
+    {
+      ring_create (&w->r, f, mode == FIO_SAVE ? SAVE_SLOTS : WRITE_SLOTS,
+		   WRITE_CHUNK);
+      w->r.event = pool_event_create ();
+      w->r.z = z;
+#ifdef FIO_FD
+      if (mode == FIO_SAVE && z == 0)
+	ring_open (&w->r, f, 1);
+      if (w->r.fd >= 0)
+	w->r.task = pool_spawn (write_file_chunks, &w->r);
+      else
+#endif
+	w->r.task = pool_spawn (write_chunks, &w->r);
+      if (w->r.task == 0)
+	ring_destroy (&w->r);
+    }
+  else
+    w->r.task = 0;
+  if (w->r.task == 0)
+#endif
+    {
+      ring_create (&w->r, f, 1, WRITE_CHUNK);
+      w->r.z = z;
+    }
+  w->fill = w->r.chunk[0];
+  w->len = 0;
+  return w;
+}
+
+/* fio_reserve - return room for n bytes, or a null pointer if n bytes
+   will never fit */
+char *
+fio_reserve (FIO_WRITER * w, size_t n)
+{
+  if (n > WRITE_CHUNK)
+    return 0;
+  if (WRITE_CHUNK - w->len < n)
+    hand_over (w);
+  return w->fill + w->len;
+}
+
+/* fio_commit - n bytes have been put where fio_reserve said */
+void
+fio_commit (FIO_WRITER * w, size_t n)
+{
+  w->len += n;
+}
+
+/* fio_write - write n bytes from s */
+void
+fio_write (FIO_WRITER * w, const char *s, size_t n)
+{
+  size_t m;
+
+  while (n != 0)
+    {
+      if (w->len == WRITE_CHUNK)
+	hand_over (w);
+      m = WRITE_CHUNK - w->len;
+      if (m > n)
+	m = n;
+      memcpy (w->fill + w->len, s, m);
+      w->len += m;
+      s += m;
+      n -= m;
+    }
+}
+
+/* fio_copy - copy n bytes at offset off of the file fd to the output */
+int
+fio_copy (FIO_WRITER * w, int fd, off_t off, size_t n)
+{
+#ifdef FIO_FD
+  if (w->r.task == 0 || w->r.fd < 0)
+    return -1;
+  if (n != 0)
+    {
+      if (w->len != 0)
+	hand_over (w);
+      put_chunk (w, fd, off, n);
+    }
+  return 0;
+#else
+  return -1;
+#endif
+}
+
+#ifdef FIO_STAT
+
+/* backup_policy - how FIO_BACKUP_ENV says fio_backup may copy files */
+static int
+backup_policy (void)
+{
+  static int policy = -1;
+  char *s;
+
+  if (policy < 0)
+    {
+      s = getenv (FIO_BACKUP_ENV);
+      if (s != 0 && strcmp (s, "rename") == 0)
+	policy = BACKUP_RENAME;
+      else if (s != 0 && strcmp (s, "clone") == 0)
+	policy = BACKUP_CLONE;
+      else
+	policy = BACKUP_COPY;
+    }
+  return policy;
+}
+
+#endif
+
+/* fio_backup - make to a copy of from without reading and writing its
+   data ourselves.  The old to is unlinked rather than truncated, since
+   someone (the buffer's origin, say) may still have it open.  */
+int
+fio_backup (char *from, char *to)
+{
+#ifdef FIO_STAT
+  struct stat st;
+  int in, out, ok = 0;
+  off_t left;
+  ssize_t n;
+
+  if (backup_policy () == BACKUP_RENAME)
+    return -1;
+  if ((in = open (from, O_RDONLY)) < 0)
+    return -1;
+  if (fstat (in, &st) != 0 || !S_ISREG (st.st_mode)
+      || (unlink (to) != 0 && access (to, F_OK) == 0)
+      || (out = open (to, O_WRONLY | O_CREAT | O_EXCL,
+		      st.st_mode & 07777)) < 0)
+    {
+      close (in);
+      return -1;
+    }
+#ifdef FICLONE
+  ok = ioctl (out, FICLONE, in) == 0;
+#endif
+#ifdef HAVE_COPY_FILE_RANGE
+  if (!ok && backup_policy () == BACKUP_COPY)
+    {
+      for (left = st.st_size; left > 0; left -= n)
+	if ((n = copy_file_range (in, 0, out, 0, left < (off_t) COPY_STEP
+				  ? (size_t) left : COPY_STEP, 0)) <= 0)
+	  break;
+      ok = left == 0;
+    }
+#endif
+#ifdef HAVE_FUTIMENS
+  if (ok)
+    {
+      /* like a renamed file, the backup keeps its times */
+      struct timespec times[2];
+
+      times[0] = st.st_atim;
+      times[1] = st.st_mtim;
+      futimens (out, times);
+    }
+#endif
+  if (close (out) != 0)
+    ok = 0;
+  close (in);
+  if (!ok)
+    unlink (to);
+  return ok ? 0 : -1;
+#else
+  return -1;
+#endif
+}
+
+/* fio_same_file - is fd open on the file called filename? */
+int
+fio_same_file (int fd, char *filename)
+{
+#ifdef FIO_STAT
+  struct stat a, b;
+
+  return fd >= 0 && fstat (fd, &a) == 0 && stat (filename, &b) == 0
+    && a.st_dev == b.st_dev && a.st_ino == b.st_ino;
+#else
+  return 0;
+#endif
+}
+
+/* fio_flush - wait until everything written so far has reached the file */
+void
+fio_flush (FIO_WRITER * w)
+{
+  if (w->len != 0)
+    hand_over (w);
+#ifdef FIO_THREADS
+  if (w->r.task != 0)
+    {
+      pool_event_wait (w->r.event, ring_is_empty, &w->r);
+      return;
+    }
+#endif
+  if (fflush (w->r.f) != 0)
+    w->r.error = 1;
+}
+
+/* fio_close - flush and stop writing; returns nonzero if there was a
+   write error.  The file itself stays open.  */
+int
+fio_close (FIO_WRITER * w)
+{
+  int error;
+
+  fio_flush (w);
+#ifdef FIO_THREADS
+  if (w->r.task != 0)
+    {
+      put_chunk (w, -1, 0, 0);
+      pool_join (w->r.task);
+    }
+#endif
+  if (w->r.z != 0 && zio_close (w->r.z) != 0)
+    w->r.error = 1;
+  error = w->r.error;
+  ring_destroy (&w->r);
+  free (w);
+  return error;
+}
+
+/* END OF FILE */
@@ -0,0 +1,124 @@
+/* fileio.h -- reading and writing whole files for edlin
+
+  DESCRIPTION:
+
+  This file contains the interface to the routines that move whole
+  files between the disk and arrays of lines, and to the buffered
+  writer that output goes through.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+#ifndef FILEIO_H
+#define FILEIO_H
+
+#include <stdio.h>
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+#include "dynstr.h"
+#include "zio.h"
+
+/* macros */
+
+/* The environment variable that picks how regular files are read and
+   written: "stdio", "pread", or (the default) io_uring where there is
+   one.  */
+#define FIO_ENV         "EDLIN_IO"
+
+/* The environment variable that says what loads and saves of regular
+   files do to the page cache: "keep" (the default), "drop" what they
+   are done with, or write saves "direct"ly to the disk.  */
+#define FIO_CACHE_ENV   "EDLIN_CACHE"
+
+/* The environment variable that says how fio_backup may copy a file:
+   "clone" it only where the file system can share its blocks, "copy"
+   it in the kernel if it cannot (the default), or not at all
+   ("rename"), leaving the caller to move the file out of the way.  */
+#define FIO_BACKUP_ENV  "EDLIN_BACKUP"
+
+/* how a writer is used */
+#define FIO_STREAM      0       /* output that other output follows */
+#define FIO_SAVE        1       /* the whole of a file just opened */
+
+/* Where a line sits in the file it was read from: the offset of its
+   first character, or FIO_NOWHERE if the file does not hold it (with a
+   newline after it) any more.  */
+#define FIO_NOWHERE     ((off_t) -1)
+
+/* typedefs */
+
+typedef struct FIO_WRITER FIO_WRITER;
+
+/* arrays of offsets, one for each line of an array of lines */
+#define T               off_t
+#define TS              ORG
+#undef  Tstorage_class
+#define PROTOS_ONLY
+#include "dynarray.h"
+#undef  T
+#undef  TS
+#undef  PROTOS_ONLY
+
+/* functions */
+
+/* read f to the end and append its lines (without their newlines) to
+   lines, and where each line was found (counting from where f was) to
+   origins unless that is a null pointer; returns nonzero if there was a
+   read error.  Unless format is ZIO_PLAIN, f is decompressed as it is
+   read, and origins has to be a null pointer.  */
+int fio_load (FILE * f, int format, DAS_ARRAY_T * lines,
+              ORG_ARRAY_T * origins);
+
+/* start writing to f through a pair of buffers, one being filled while
+   the other is written out by a helper task.  With FIO_SAVE, a regular
+   file is written straight through its descriptor, not through f.
+   Unless format is ZIO_PLAIN, what is written is compressed.  */
+FIO_WRITER *fio_writer (FILE * f, int mode, int format);
+
+/* return room for n bytes in the buffer being filled, or a null pointer
+   if n is more than a buffer holds; fio_commit then says how many bytes
+   were put there */
+char *fio_reserve (FIO_WRITER * w, size_t n);
+void fio_commit (FIO_WRITER * w, size_t n);
+
+/* write n bytes from s */
+void fio_write (FIO_WRITER * w, const char *s, size_t n);
+
+/* copy n bytes at offset off of the file fd to the output, inside the
+   kernel where it can; returns nonzero (and copies nothing) if the
+   writer cannot do that, in which case the caller writes them itself */
+int fio_copy (FIO_WRITER * w, int fd, off_t off, size_t n);
+
+/* make the file called to a copy of the file called from without the
+   data passing through edlin, by cloning it or having the kernel copy
+   it; returns nonzero if that could not be done */
+int fio_backup (char *from, char *to);
+
+/* is fd open on the file called filename? */
+int fio_same_file (int fd, char *filename);
+
+/* wait until everything written so far has reached the file */
+void fio_flush (FIO_WRITER * w);
+
+/* flush and stop writing; returns nonzero if there was a write error.
+   The file itself is left open.  */
+int fio_close (FIO_WRITER * w);
+
+#endif
+
+/* END OF FILE */
@@ -0,0 +1,381 @@
+/* find.c -- searching many files at once
+
+  DESCRIPTION:
+
+  This file contains edlin's search of files that are not in the
+  buffer.  Each file is a piece of work for the worker pool.  Plain
+  files are mapped into memory and scanned from end to end with the
+  same memchr() and memcmp() loop as DSfind(), counting newlines only
+  up to each match instead of splitting the whole file into lines;
+  compressed files, and every file on systems without mmap(), are read
+  through fio_load() and searched a line at a time.  What is found in a
+  file is kept apart from what is found in the others until the pool is
+  done, so that the threads never share anything they write to, and
+  the results come out in the order of the list however the work was
+  shared out.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+/* includes */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#endif
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+#include "cancel.h"
+#include "dynstr.h"
+#include "fileio.h"
+#include "find.h"
+#include "json.h"
+#include "msgs.h"
+#include "pool.h"
+#include "zio.h"
+
+/* macros */
+
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_SYS_STAT_H)
+#define FIND_MMAP                       /* plain files can be mapped */
+#endif
+
+/* How much of a mapped file is searched between looks at whether the
+   search has been interrupted.  */
+#define SCAN_STEP                       (1024 * 1024)
+
+/* typedefs */
+
+/* a line that was found */
+typedef struct HIT
+{
+  size_t file;                  /* which file, in the list */
+  unsigned long line;           /* which line, counting from 1 */
+} HIT;
+
+/* Invoke "dynarray.h" to get us arrays of hits. */
+#define T               HIT
+#define TS              HIT
+#define PROTOS_ONLY
+#include "dynarray.h"
+#define Tassign(x,y)    (*(x) = *(y))
+#define Tctor(x)        ((x)->file = 0, (x)->line = 0)
+#define Tdtor(x)
+#define Trelocatable
+#undef  Tstorage_class
+#undef  PROTOS_ONLY
+#include "dynarray.h"
+#undef  T
+#undef  TS
+#undef  Tassign
+#undef  Tctor
+#undef  Tdtor
+#undef  Trelocatable
+
+/* what was found in one file */
+typedef struct FOUND
+{
+  HIT_ARRAY_T *hits;            /* null until something is found */
+  DAS_ARRAY_T *text;            /* the lines themselves */
+  int failed;                   /* the file could not be read */
+} FOUND;
+
+/* what the pool works on */
+typedef struct JOB
+{
+  DAS_ARRAY_T *names;
+  char *s;
+  size_t n;
+  FOUND *found;                 /* one for each name */
+} JOB;
+
+/* static variables */
+
+static DAS_ARRAY_T *hit_names = 0;
+static HIT_ARRAY_T *hits = 0;
+static DAS_ARRAY_T *hit_text = 0;
+
+/* functions */
+
+/* add_hit - note that line, n characters at s, of file holds the
+   string */
+static void
+add_hit (FOUND * f, size_t file, unsigned long line, char *s, size_t n)
+{
+  HIT h;
+  STRING_T *ds;
+
+  if (f->hits == 0)
+    {
+      f->hits = HIT_create ();
+      f->text = DAS_create ();
+    }
+  h.file = file;
+  h.line = line;
+  HIT_append (f->hits, &h, 1, 1);
+  if (n > 0 && s[n - 1] == '\r')
+    n--;
+  ds = DScreate ();
+  DSassigncstr (ds, s, n);
+  DAS_append (f->text, ds, 1, 1);
+  DSdestroy (ds);
+}
+
+#ifdef FIND_MMAP
+/* find_in - find the first n characters of s in the len characters at
+   p; returns a null pointer if they are not there */
+static char *
+find_in (char *p, size_t len, char *s, size_t n)
+{
+  size_t nmax;
+  char *t;
+
+  if (n > len)
+    return 0;
+  for (nmax = len - n + 1;
+       (t = (char *) memchr (p, *s, nmax)) != 0; nmax -= t - p + 1, p = t + 1)
+    if (memcmp (t, s, n) == 0)
+      return t;
+  return 0;
+}
+
+/* scan_map - search the len characters of a mapped file at p */
+static void
+scan_map (JOB * job, size_t file, char *p, size_t len)
+{
+  char *end = p + len, *bol = p, *t = p, *nl, *m;
+  unsigned long line = 1;
+  size_t left, step;
+
+  while (t < end && !cancelled ())
+    {
+      /* look a step at a time, so that an interrupt is noticed soon; a
+	 match may run on past the step */
+      left = end - t;
+      step = left < SCAN_STEP ? left : SCAN_STEP;
+      if ((m = find_in (t, left < step + job->n - 1 ? left
+			: step + job->n - 1, job->s, job->n)) == 0)
+	{
+	  t += step;
+	  continue;
+	}
+      t = m;
+      /* count the lines up to the match */
+      while ((nl = memchr (bol, '\n', t - bol)) != 0)
+	{
+	  line++;
+	  bol = nl + 1;
+	}
+      if ((nl = memchr (t, '\n', end - t)) == 0)
+	nl = end;
+      add_hit (&job->found[file], file, line, bol, nl - bol);
+      if (nl == end)
+	break;
+      bol = t = nl + 1;
+      line++;
+    }
+}
+
+/* search_map - search a plain file by mapping it; returns zero if it
+   could not be mapped */
+static int
+search_map (JOB * job, size_t file, FILE * f)
+{
+  struct stat st;
+  void *p;
+
+  if (fstat (fileno (f), &st) != 0 || !S_ISREG (st.st_mode)
+      || (off_t) (size_t) st.st_size != st.st_size)
+    return 0;
+  if (st.st_size == 0)
+    return 1;
+  p = mmap (0, (size_t) st.st_size, PROT_READ, MAP_PRIVATE, fileno (f), 0);
+  if (p == MAP_FAILED)
+    return 0;
+#ifdef MADV_SEQUENTIAL
+  madvise (p, (size_t) st.st_size, MADV_SEQUENTIAL);
+#endif
+  scan_map (job, file, p, (size_t) st.st_size);
+  munmap (p, (size_t) st.st_size);
+  return 1;
+}
+#endif
+
+/* search_lines - search a file by loading its lines */
+static void
+search_lines (JOB * job, size_t file, FILE * f, int format)
+{
+  DAS_ARRAY_T *lines = DAS_create ();
+  STRING_T *ds;
+  size_t i;
+
+  /* a file cut short by an interrupt was read, just not all of it */
+  if (fio_load (f, format, lines, 0) != 0 && !cancelled ())
+    job->found[file].failed = 1;
+  for (i = 0; i < DAS_length (lines); ++i)
+    {
+      ds = DAS_get_at (lines, i);
+      if (DSfind (ds, job->s, 0, job->n) != NPOS)
+	add_hit (&job->found[file], file, (unsigned long) i + 1,
+		 DScstr (ds), DSlength (ds));
+    }
+  DAS_destroy (lines);
+}
+
+/* search_range - pool_range_fn that searches the files first through
+   last - 1 */
+static void
+search_range (void *arg, unsigned long first, unsigned long last)
+{
+  JOB *job = arg;
+  FILE *f;
+  int format;
+
+  /* once interrupted, the files not yet started are left alone */
+  for (; first < last && !cancelled (); ++first)
+    {
+      if ((f = fopen (DScstr (DAS_get_at (job->names, first)), "rb")) == 0)
+	{
+	  job->found[first].failed = 1;
+	  continue;
+	}
+      format = zio_detect (f);
+#ifdef FIND_MMAP
+      if (format != ZIO_PLAIN || !search_map (job, first, f))
+#endif
+	search_lines (job, first, f, format);
+      fclose (f);
+    }
+}
+
+/* print_hit - print the hit'th line found */
+static void
+print_hit (unsigned long hit)
+{
+  static STRING_T *out = 0;
+  HIT *h = HIT_get_at (hits, hit);
+  STRING_T *ds = DAS_get_at (hit_text, hit);
+  char *filename = DScstr (DAS_get_at (hit_names, h->file));
+
+  if (json_output)
+    {
+      if (out == 0)
+	out = DScreate ();
+      json_begin (out, "hit");
+      json_number (out, "hit", hit + 1);
+      json_string (out, "file", filename, NPOS);
+      json_number (out, "line", h->line);
+      json_string (out, "text", DScstr (ds), DSlength (ds));
+      json_end (out);
+      fputs (DScstr (out), stdout);
+      return;
+    }
+  printf (G00054, hit + 1, filename, h->line);
+  fwrite (DScstr (ds), 1, DSlength (ds), stdout);
+  putchar ('\n');
+}
+
+/* find_files - search the files for a string */
+unsigned long
+find_files (DAS_ARRAY_T * names, char *s, size_t n)
+{
+  JOB job;
+  FOUND *f;
+  size_t i, count = DAS_length (names);
+  unsigned long hit = 0;
+
+  find_clear ();
+  hit_names = names;
+  hits = HIT_create ();
+  hit_text = DAS_create ();
+  if (n == 0 || memchr (s, '\n', n) != 0)
+    return 0;
+  if ((job.found = calloc (count + 1, sizeof (FOUND))) == 0)
+    Nomemory ();
+  job.names = names;
+  job.s = s;
+  job.n = n;
+  pool_for_range (0, count, 1, search_range, &job);
+  for (i = 0; i < count; ++i)
+    {
+      f = job.found + i;
+      if (f->failed && json_output)
+	json_record ("error", "cannot_open", DScstr (DAS_get_at (names, i)));
+      else if (f->failed)
+	fprintf (stderr, G00048, DScstr (DAS_get_at (names, i)));
+      if (f->hits == 0)
+	continue;
+      HIT_append (hits, HIT_base (f->hits), HIT_length (f->hits), 1);
+      DAS_append (hit_text, DAS_base (f->text), DAS_length (f->text), 1);
+      HIT_destroy (f->hits);
+      DAS_destroy (f->text);
+      for (; hit < HIT_length (hits); ++hit)
+	print_hit (hit);
+    }
+  free (job.found);
+  /* a file that was being read when the interrupt came was cut short */
+  if (cancelled ())
+    json_puts ("status", "interrupted", G00058);
+  return hit;
+}
+
+/* find_count - how many lines the last search found */
+unsigned long
+find_count (void)
+{
+  return hits != 0 ? HIT_length (hits) : 0;
+}
+
+/* find_hit - where the hit'th line found is */
+char *
+find_hit (unsigned long hit, unsigned long *line)
+{
+  HIT *h = HIT_get_at (hits, hit);
+
+  *line = h->line;
+  return DScstr (DAS_get_at (hit_names, h->file));
+}
+
+/* find_list - print the lines found again */
+void
+find_list (void)
+{
+  unsigned long hit;
+
+  for (hit = 0; hit < find_count (); ++hit)
+    print_hit (hit);
+}
+
+/* find_clear - forget the lines found */
+void
+find_clear (void)
+{
+  if (hits != 0)
+    {
+      HIT_destroy (hits);
+      DAS_destroy (hit_text);
+      DAS_destroy (hit_names);
+    }
+  hits = 0;
+  hit_text = hit_names = 0;
+}
+
+/* END OF FILE */
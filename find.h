@@ -0,0 +1,57 @@
+/* find.h -- searching many files at once
+
+  DESCRIPTION:
+
+  This file contains the interface to edlin's search of files that are
+  not in the buffer.  The files of a list are shared out among the
+  threads of the worker pool, each of which maps its files into memory
+  where it can and scans them for the string; the lines found are
+  printed in the order of the list, and remembered so that any one of
+  them can be opened in the buffer afterwards.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+#ifndef FIND_H
+#define FIND_H
+
+#include "dynstr.h"
+
+/* functions */
+
+/* search the files named in names, which from then on belong to this
+   module, for the first n characters of s; the lines found are printed,
+   numbered from 1, and take the place of those found before.  Returns
+   how many lines were found.  */
+unsigned long find_files (DAS_ARRAY_T * names, char *s, size_t n);
+
+/* how many lines the last search found */
+unsigned long find_count (void);
+
+/* the name of the file the hit'th line found (counting from 0) is in,
+   and in *line, its line number (counting from 1) */
+char *find_hit (unsigned long hit, unsigned long *line);
+
+/* print the lines found again */
+void find_list (void);
+
+/* forget the lines found */
+void find_clear (void);
+
+#endif
+
+/* END OF FILE */
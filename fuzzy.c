@@ -0,0 +1,203 @@
+/* fuzzy.c -- finding text that is nearly the same as a string
+
+  DESCRIPTION:
+
+  This file contains edlin's approximate search, which uses Myers's
+  bit-parallel form of the edit distance table.  Each column of the
+  table, one row for each character of the pattern, is kept as two
+  words of bits saying where going down a row adds one to the distance
+  and where it takes one away, so that a whole column is worked out
+  from the one before with a handful of word operations for each
+  character of the line.  A pattern longer than a word takes several
+  words, with the change along the bottom of one word carried into the
+  top of the next.  The last row holds the fewest edits that turn some
+  part of the line ending at that character into the pattern, and the
+  line matches as soon as that is no more than the edits allowed.
+
+  Lines too short to hold the pattern even with every edit used are
+  turned down without looking at them.  The search of the buffer itself
+  is shared out among the worker pool like the exact one; nothing here
+  is written to once the pattern has been made.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+/* includes */
+
+#include "config.h"
+#include <limits.h>
+#include <stdlib.h>
+#include "defines.h"
+#include "fuzzy.h"
+
+/* macros */
+
+/* how many bits there are in a word, and the highest of them */
+#define WORD_BITS       (CHAR_BIT * sizeof (unsigned long))
+#define WORD_TOP        (1UL << (WORD_BITS - 1))
+
+/* how many words of a long pattern are worked on without malloc */
+#define STACK_WORDS     4
+
+/* typedefs */
+
+struct FUZZY
+{
+  unsigned long *peq;           /* where each character is, by word */
+  size_t m;                     /* how long the pattern is */
+  size_t words;                 /* how many words it takes up */
+  unsigned long top;            /* the last row's bit in the last word */
+  unsigned k;                   /* the most edits allowed */
+};
+
+/* functions */
+
+/* fuzzy_create - make a pattern */
+FUZZY *
+fuzzy_create (const char *s, size_t n, unsigned k)
+{
+  FUZZY *fz;
+  size_t i;
+
+  if ((fz = malloc (sizeof (FUZZY))) == 0)
+    Nomemory ();
+  fz->m = n;
+  fz->k = k;
+  fz->words = n != 0 ? (n + WORD_BITS - 1) / WORD_BITS : 1;
+  fz->top = 1UL << (n != 0 ? (n - 1) % WORD_BITS : 0);
+  if ((fz->peq = calloc ((UCHAR_MAX + 1) * fz->words,
+			 sizeof (unsigned long))) == 0)
+    Nomemory ();
+  for (i = 0; i < n; ++i)
+    fz->peq[(unsigned char) s[i] * fz->words + i / WORD_BITS]
+      |= 1UL << (i % WORD_BITS);
+  return fz;
+}
+
+/* match_word - fuzzy_match for a pattern that fits in a word */
+static int
+match_word (FUZZY * fz, const unsigned char *t, const unsigned char *end)
+{
+  unsigned long pv = ~0UL, mv = 0, eq, xv, xh, ph, mh;
+  size_t score = fz->m;
+
+  for (; t < end; ++t)
+    {
+      eq = fz->peq[*t];
+      xv = eq | mv;
+      xh = (((eq & pv) + pv) ^ pv) | eq;
+      ph = mv | ~(xh | pv);
+      mh = pv & xh;
+      if (ph & fz->top)
+	score++;
+      else if (mh & fz->top)
+	score--;
+      if (score <= fz->k)
+	return 1;
+      ph <<= 1;
+      mh <<= 1;
+      pv = mh | ~(xv | ph);
+      mv = ph & xv;
+    }
+  return 0;
+}
+
+/* match_words - fuzzy_match for a pattern that takes several words;
+   pv and mv have room for a word each */
+static int
+match_words (FUZZY * fz, const unsigned char *t, const unsigned char *end,
+	     unsigned long *pv, unsigned long *mv)
+{
+  unsigned long eq, xv, xh, ph, mh, *row, high;
+  size_t score = fz->m, w, last = fz->words - 1;
+  int hin, hout;
+
+  for (w = 0; w <= last; ++w)
+    {
+      pv[w] = ~0UL;
+      mv[w] = 0;
+    }
+  for (; t < end; ++t)
+    {
+      row = fz->peq + *t * fz->words;
+      /* the top row of the table is all zeroes, so nothing comes in */
+      hin = 0;
+      for (w = 0; w <= last; ++w)
+	{
+	  eq = row[w];
+	  xv = eq | mv[w];
+	  if (hin < 0)
+	    eq |= 1;
+	  xh = (((eq & pv[w]) + pv[w]) ^ pv[w]) | eq;
+	  ph = mv[w] | ~(xh | pv[w]);
+	  mh = pv[w] & xh;
+	  high = w == last ? fz->top : WORD_TOP;
+	  hout = (ph & high) ? 1 : (mh & high) ? -1 : 0;
+	  ph <<= 1;
+	  mh <<= 1;
+	  if (hin < 0)
+	    mh |= 1;
+	  else if (hin > 0)
+	    ph |= 1;
+	  pv[w] = mh | ~(xv | ph);
+	  mv[w] = ph & xv;
+	  hin = hout;
+	}
+      if (hin > 0)
+	score++;
+      else if (hin < 0)
+	score--;
+      if (score <= fz->k)
+	return 1;
+    }
+  return 0;
+}
+
+/* fuzzy_match - does some part of the n characters at t match? */
+int
+fuzzy_match (FUZZY * fz, const char *t, size_t n)
+{
+  const unsigned char *s = (const unsigned char *) t;
+  unsigned long stack[2 * STACK_WORDS], *v = stack;
+  int r;
+
+  if (fz->m <= fz->k)
+    return 1;
+  if (n + fz->k < fz->m)
+    return 0;
+  if (fz->words == 1)
+    return match_word (fz, s, s + n);
+  if (fz->words > STACK_WORDS
+      && (v = malloc (2 * fz->words * sizeof (unsigned long))) == 0)
+    Nomemory ();
+  r = match_words (fz, s, s + n, v, v + fz->words);
+  if (v != stack)
+    free (v);
+  return r;
+}
+
+/* fuzzy_destroy - throw a pattern away */
+void
+fuzzy_destroy (FUZZY * fz)
+{
+  if (fz == 0)
+    return;
+  free (fz->peq);
+  free (fz);
+}
+
+/* END OF FILE */
@@ -0,0 +1,52 @@
+/* fuzzy.h -- finding text that is nearly the same as a string
+
+  DESCRIPTION:
+
+  This file contains the interface to edlin's approximate search.  A
+  pattern is made once from the string and the number of edits to
+  allow, and can then be matched against any number of lines, from any
+  number of threads at once: a line matches if some part of it can be
+  turned into the string by no more than that many characters put in,
+  taken out or changed.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+#ifndef FUZZY_H
+#define FUZZY_H
+
+#include <stddef.h>
+
+/* typedefs */
+
+typedef struct FUZZY FUZZY;
+
+/* functions */
+
+/* make a pattern that matches the first n characters of s with up to k
+   edits */
+FUZZY *fuzzy_create (const char *s, size_t n, unsigned k);
+
+/* does some part of the n characters at t match the pattern? */
+int fuzzy_match (FUZZY * fz, const char *t, size_t n);
+
+/* throw the pattern away; a null pointer is let be */
+void fuzzy_destroy (FUZZY * fz);
+
+#endif
+
+/* END OF FILE */
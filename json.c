@@ -0,0 +1,236 @@
+/* json.c -- output for programs instead of people
+
+  DESCRIPTION:
+
+  This file contains edlin's JSON output.  Records are built in a
+  string and written out whole.  Most of what goes into them is the text
+  of lines, which needs escaping only in the rare places where it holds
+  a quotation mark, a backslash or a control character, so the text is
+  looked at a word at a time, with the same trick as the strchr() in
+  edlib.c, and copied across in runs up to each character that needs
+  escaping.  Characters above 127 are passed through as they are.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+/* includes */
+
+#include "config.h"
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include "dynstr.h"
+#include "json.h"
+#include "msgs.h"
+
+/* macros */
+
+#ifndef OPTIMIZED_FOR_SIZE
+/* a byte of X is zero, or less than N (which is at most 128) */
+#if ULONG_MAX == 0xFFFFFFFFUL
+#define ONES            0x01010101UL
+#elif ULONG_MAX == 0xFFFFFFFFFFFFFFFFUL
+#define ONES            0x0101010101010101UL
+#else
+#error unsigned long is not 32 or 64 bits wide
+#endif
+#if UCHAR_MAX != 0xFF
+#error char is not 8 bits wide
+#endif
+#define DETECTLESS(X,N) (((X)-ONES*(N))&~(X)&(ONES*0x80))
+#define DETECTNULL(X)   DETECTLESS(X,1)
+/* Detect whether X holds a character that has to be escaped */
+#define DETECTESCAPE(X) (DETECTLESS(X,0x20)|DETECTNULL((X)^(ONES*'"')) \
+			 |DETECTNULL((X)^(ONES*'\\')))
+#endif
+
+/* a character that has to be escaped */
+#define ESCAPED(C)      ((unsigned char) (C) < 0x20 || (C) == '"' \
+			 || (C) == '\\')
+
+/* global variables */
+
+int json_output = 0;
+
+/* functions */
+
+/* json_escape - append characters to out, escaped */
+void
+json_escape (STRING_T * out, char *s, size_t n)
+{
+  static char hex[] = "0123456789abcdef";
+  char *end = s + n, *run = s, *p;
+  char esc[6];
+#ifndef OPTIMIZED_FOR_SIZE
+  unsigned long w;
+#endif
+
+  for (;;)
+    {
+#ifndef OPTIMIZED_FOR_SIZE
+      /* skip the words that need nothing done to them */
+      while ((size_t) (end - s) >= sizeof w)
+	{
+	  memcpy (&w, s, sizeof w);
+	  if (DETECTESCAPE (w))
+	    break;
+	  s += sizeof w;
+	}
+#endif
+      while (s < end && !ESCAPED (*s))
+	s++;
+      DSappendcstr (out, run, s - run);
+      if (s == end)
+	break;
+      p = esc;
+      *p++ = '\\';
+      switch (*s)
+	{
+	case '"':
+	case '\\':
+	  *p++ = *s;
+	  break;
+	case '\b':
+	  *p++ = 'b';
+	  break;
+	case '\f':
+	  *p++ = 'f';
+	  break;
+	case '\n':
+	  *p++ = 'n';
+	  break;
+	case '\r':
+	  *p++ = 'r';
+	  break;
+	case '\t':
+	  *p++ = 't';
+	  break;
+	default:
+	  *p++ = 'u';
+	  *p++ = '0';
+	  *p++ = '0';
+	  *p++ = hex[(*s >> 4) & 15];
+	  *p++ = hex[*s & 15];
+	  break;
+	}
+      DSappendcstr (out, esc, p - esc);
+      run = ++s;
+    }
+}
+
+/* json_begin - start a record */
+void
+json_begin (STRING_T * out, char *type)
+{
+  DSassigncstr (out, "{\"type\":\"", NPOS);
+  DSappendcstr (out, type, NPOS);
+  DSappendchar (out, '"', 1);
+}
+
+/* json_string - add a string to a record */
+void
+json_string (STRING_T * out, char *name, char *s, size_t n)
+{
+  DSappendcstr (out, ",\"", 2);
+  DSappendcstr (out, name, NPOS);
+  DSappendcstr (out, "\":\"", 3);
+  json_escape (out, s, n == NPOS ? strlen (s) : n);
+  DSappendchar (out, '"', 1);
+}
+
+/* json_number - add a number to a record */
+void
+json_number (STRING_T * out, char *name, unsigned long n)
+{
+  char num[3 * sizeof (unsigned long) + 2];
+
+  DSappendcstr (out, ",\"", 2);
+  DSappendcstr (out, name, NPOS);
+  DSappendcstr (out, "\":", 2);
+  DSappendcstr (out, num, sprintf (num, "%lu", n));
+}
+
+/* json_real - add a number that need not be a whole one to a record;
+   JSON has no infinity, so anything that is not finite is null */
+void
+json_real (STRING_T * out, char *name, double x)
+{
+  char num[32];
+
+  DSappendcstr (out, ",\"", 2);
+  DSappendcstr (out, name, NPOS);
+  DSappendcstr (out, "\":", 2);
+  if (x - x == 0)
+    DSappendcstr (out, num, sprintf (num, "%.17g", x));
+  else
+    DSappendcstr (out, "null", 4);
+}
+
+/* json_flag - add true or false to a record */
+void
+json_flag (STRING_T * out, char *name, int flag)
+{
+  DSappendcstr (out, ",\"", 2);
+  DSappendcstr (out, name, NPOS);
+  DSappendcstr (out, flag ? "\":true" : "\":false", NPOS);
+}
+
+/* json_end - finish a record */
+void
+json_end (STRING_T * out)
+{
+  DSappendcstr (out, "}\n", 2);
+}
+
+/* json_record - print a record with an id and a filename */
+void
+json_record (char *type, char *id, char *filename)
+{
+  static STRING_T *out = 0;
+
+  if (out == 0)
+    out = DScreate ();
+  json_begin (out, type);
+  if (id != 0)
+    json_string (out, "id", id, NPOS);
+  if (filename != 0)
+    json_string (out, "file", filename, NPOS);
+  json_end (out);
+  fwrite (DScstr (out), 1, DSlength (out), stdout);
+}
+
+/* json_puts - put out a status message */
+void
+json_puts (char *type, char *id, char *msg)
+{
+  if (json_output)
+    json_record (type, id, 0);
+  else
+    puts (msg);
+}
+
+/* json_error - put out an error message */
+void
+json_error (char *id, char *msg)
+{
+  if (json_output)
+    json_record ("error", id, 0);
+  else
+    fprintf (stderr, G00037, msg);
+}
+
+/* END OF FILE */
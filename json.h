@@ -0,0 +1,69 @@
+/* json.h -- output for programs instead of people
+
+  DESCRIPTION:
+
+  This file contains the interface to edlin's JSON output.  With the -j
+  option, what edlin prints is written as one JSON object per line
+  (lines listed, lines found, replacements, files read and written, and
+  errors), each with a "type" member saying what it is.  Messages are
+  named by an "id" that does not change from one language to the next,
+  in place of their text from the message catalog, and the prompts are
+  left out altogether.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+#ifndef JSON_H
+#define JSON_H
+
+#include "dynstr.h"
+
+/* global variables */
+
+/* nonzero when the output is JSON */
+extern int json_output;
+
+/* functions */
+
+/* A record is built up in a string, starting with json_begin (which
+   empties it first) and ending with json_end, and can then be written
+   out wherever the caller likes.  */
+void json_begin (STRING_T * out, char *type);
+void json_string (STRING_T * out, char *name, char *s, size_t n);
+void json_number (STRING_T * out, char *name, unsigned long n);
+void json_real (STRING_T * out, char *name, double x);
+void json_flag (STRING_T * out, char *name, int flag);
+void json_end (STRING_T * out);
+
+/* append the n characters at s to out, escaped for a JSON string */
+void json_escape (STRING_T * out, char *s, size_t n);
+
+/* print a record of the given type, with an id and a filename unless
+   they are null pointers */
+void json_record (char *type, char *id, char *filename);
+
+/* put out msg, which is a status message such as "Not found", as edlin
+   always has, or a record of the given type and id */
+void json_puts (char *type, char *id, char *msg);
+
+/* put out an error message on the standard error as edlin always has,
+   or an error record with the given id */
+void json_error (char *id, char *msg);
+
+#endif
+
+/* END OF FILE */
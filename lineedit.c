@@ -0,0 +1,481 @@
+/* lineedit.c -- editing a line from the keyboard, with a template
+
+  DESCRIPTION:
+
+  This file contains the line editor behind edlin's # command.  The
+  terminal is put into raw mode for as long as the line is edited, and
+  keys are read as many at a time as the terminal has ready.  Whatever
+  the keys do to the screen is gathered up and written out in one go
+  when they have all been handled, and only what has changed is drawn:
+  characters are only ever added or taken away at the end of the line,
+  so a key costs the same on a long line as on a short one.
+
+  The cursor is kept track of by counting, from the left margin: when a
+  character fills the last column of a row, the cursor is moved to the
+  start of the next row at once rather than left to the terminal, which
+  would otherwise leave it hanging at the end of the row in whatever way
+  it likes.  Going back over characters goes up as many rows as needed
+  and clears everything after the cursor.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+/* includes */
+
+#include "config.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#ifdef HAVE_TERMIOS_H
+#include <termios.h>
+#endif
+#ifdef HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#endif
+#include "dynstr.h"
+#include "lineedit.h"
+
+/* macros */
+
+#if defined(HAVE_TERMIOS_H) && defined(HAVE_TCGETATTR) && defined(HAVE_ISATTY)
+#define RAW_TERMINAL
+#endif
+
+#ifdef RAW_TERMINAL
+
+/* the keys that come as escape sequences */
+#define KEY_F1          0x101
+#define KEY_F2          0x102
+#define KEY_F3          0x103
+#define KEY_INS         0x104
+#define KEY_DEL         0x105
+#define KEY_LEFT        0x106
+#define KEY_RIGHT       0x107
+#define KEY_ESC         0x108
+#define KEY_OTHER       0x109   /* one we do nothing with */
+
+#define CONTROL(c)      ((c) & 0x1F)
+#define ESC             0x1B
+
+/* what each character of the line takes up on the screen, and whether
+   it used up a character of the template, as one byte per character */
+#define CELL_WIDTH(b)   ((size_t) ((b) & 0x0F))
+#define CELL_USED       0x10
+
+/* how wide the screen is taken to be if the terminal will not say */
+#define DEFAULT_WIDTH   80
+
+#endif /* RAW_TERMINAL */
+
+/* typedefs */
+
+#ifdef RAW_TERMINAL
+typedef struct EDITOR
+{
+  char *prompt;
+  const char *tmpl;             /* the template */
+  size_t tlen, tat;             /* its length, and how much is used up */
+  STRING_T *line;               /* what has been typed so far */
+  STRING_T *cells;              /* and what each character of it takes */
+  STRING_T *screen;             /* what is to be written out next */
+  size_t pos;                   /* the cursor, counting from the margin */
+  size_t width;                 /* of the screen */
+  int insert;                   /* typing in front of the template? */
+} EDITOR;
+#endif
+
+/* static variables */
+
+#ifdef RAW_TERMINAL
+static char in[256];            /* keys read but not handled yet */
+static size_t in_at = 0, in_len = 0;
+static struct termios cooked;
+#endif
+
+/* functions */
+
+#ifdef RAW_TERMINAL
+
+/* flush - write out what the keys have done to the screen */
+static void
+flush (EDITOR * e)
+{
+  const char *s = DScstr (e->screen);
+  size_t n = DSlength (e->screen);
+  ssize_t w;
+
+  while (n > 0)
+    {
+      if ((w = write (1, s, n)) < 0)
+	{
+	  if (errno == EINTR)
+	    continue;
+	  break;
+	}
+      s += w;
+      n -= (size_t) w;
+    }
+  DSresize (e->screen, 0, 0);
+}
+
+/* fill - read as many keys as the terminal has ready, waiting for at
+   least one unless patient is zero, when it waits only briefly; returns
+   zero if there were none */
+static int
+fill (int patient)
+{
+  struct termios t;
+  ssize_t n;
+
+  if (!patient)
+    {
+      /* is a lone escape the Esc key, or the start of a sequence? */
+      tcgetattr (0, &t);
+      t.c_cc[VMIN] = 0;
+      t.c_cc[VTIME] = 1;
+      tcsetattr (0, TCSANOW, &t);
+    }
+  while ((n = read (0, in, sizeof in)) < 0 && errno == EINTR)
+    ;
+  if (!patient)
+    {
+      t.c_cc[VMIN] = 1;
+      t.c_cc[VTIME] = 0;
+      tcsetattr (0, TCSANOW, &t);
+    }
+  in_at = 0;
+  in_len = n > 0 ? (size_t) n : 0;
+  return in_len != 0;
+}
+
+/* next_byte - the next key typed, or EOF */
+static int
+next_byte (EDITOR * e, int patient)
+{
+  if (in_at == in_len)
+    {
+      /* nothing more to do until more keys come, so show what has been
+	 done so far */
+      flush (e);
+      if (!fill (patient))
+	return EOF;
+    }
+  return (unsigned char) in[in_at++];
+}
+
+/* read_key - the next key, with the escape sequences of the keys we know
+   turned into KEY_ codes */
+static int
+read_key (EDITOR * e)
+{
+  int c, kind, num = 0, first = 1;
+
+  if ((c = next_byte (e, 1)) != ESC)
+    return c;
+  if ((kind = next_byte (e, 0)) != '[' && kind != 'O')
+    {
+      /* Esc, then an ordinary key */
+      if (kind != EOF)
+	in_at--;
+      return KEY_ESC;
+    }
+  c = next_byte (e, 1);
+  if (kind == '[' && c == '[')
+    {
+      /* the Linux console writes F1 to F5 as ESC [ [ A to ESC [ [ E */
+      c = next_byte (e, 1);
+      return c == 'A' ? KEY_F1 : c == 'B' ? KEY_F2 : c == 'C' ? KEY_F3
+	: KEY_OTHER;
+    }
+  /* skip the parameters, keeping the first */
+  for (; c != EOF && (c < 0x40 || c > 0x7E); c = next_byte (e, 1))
+    if (c == ';')
+      first = 0;
+    else if (first && c >= '0' && c <= '9' && num < 1000)
+      num = num * 10 + (c - '0');
+  switch (c)
+    {
+    case 'P':
+      return KEY_F1;
+    case 'Q':
+      return KEY_F2;
+    case 'R':
+      return KEY_F3;
+    case 'C':
+      return KEY_RIGHT;
+    case 'D':
+      return KEY_LEFT;
+    case '~':
+      return num == 11 ? KEY_F1 : num == 12 ? KEY_F2 : num == 13 ? KEY_F3
+	: num == 2 ? KEY_INS : num == 3 ? KEY_DEL : KEY_OTHER;
+    default:
+      return KEY_OTHER;
+    }
+}
+
+/* move_to - move the cursor back to pos, and clear the screen after
+   it */
+static void
+move_to (EDITOR * e, size_t pos)
+{
+  char seq[32];
+  size_t rows = e->pos / e->width - pos / e->width;
+
+  if (rows != 0)
+    {
+      sprintf (seq, "\033[%luA", (unsigned long) rows);
+      DSappendcstr (e->screen, seq, NPOS);
+    }
+  DSappendchar (e->screen, '\r', 1);
+  if (pos % e->width != 0)
+    {
+      sprintf (seq, "\033[%luC", (unsigned long) (pos % e->width));
+      DSappendcstr (e->screen, seq, NPOS);
+    }
+  DSappendcstr (e->screen, "\033[J", NPOS);
+  e->pos = pos;
+}
+
+/* advance - the cursor has moved on by n columns */
+static void
+advance (EDITOR * e, size_t n)
+{
+  if (n != 0 && (e->pos += n) % e->width == 0)
+    DSappendcstr (e->screen, "\r\n", NPOS);
+}
+
+/* put_char - add c to the line, used saying whether it uses up a
+   character of the template */
+static void
+put_char (EDITOR * e, int c, int used)
+{
+  size_t w;
+
+  if (c == '\t')
+    {
+      w = 8 - e->pos % 8;
+      DSappendchar (e->screen, ' ', w);
+    }
+  else if (c < 0x20 || c == 0x7F)
+    {
+      w = 2;
+      DSappendchar (e->screen, '^', 1);
+      DSappendchar (e->screen, c ^ 0x40, 1);
+    }
+  else
+    {
+      w = 1;
+      DSappendchar (e->screen, c, 1);
+    }
+  DSappendchar (e->line, c, 1);
+  DSappendchar (e->cells, (int) w | (used ? CELL_USED : 0), 1);
+  advance (e, w);
+}
+
+/* copy - copy the template up to (but not including) end */
+static void
+copy (EDITOR * e, size_t end)
+{
+  while (e->tat < end)
+    put_char (e, (unsigned char) e->tmpl[e->tat++], 1);
+}
+
+/* rub_out - take the last character off the line */
+static void
+rub_out (EDITOR * e)
+{
+  size_t n = DSlength (e->line);
+  int cell;
+
+  if (n == 0)
+    return;
+  cell = (unsigned char) DSget_at (e->cells, n - 1);
+  DSresize (e->line, n - 1, 0);
+  DSresize (e->cells, n - 1, 0);
+  if (cell & CELL_USED)
+    e->tat--;
+  move_to (e, e->pos - CELL_WIDTH (cell));
+}
+
+/* start - start the line (again), with none of the template used */
+static void
+start (EDITOR * e)
+{
+  DSresize (e->line, 0, 0);
+  DSresize (e->cells, 0, 0);
+  e->tat = 0;
+  e->insert = 0;
+  e->pos = 0;
+  DSappendcstr (e->screen, e->prompt, NPOS);
+  advance (e, strlen (e->prompt));
+}
+
+/* edit - handle keys until the line is done */
+static int
+edit (EDITOR * e)
+{
+  const char *found;
+  int c;
+
+  start (e);
+  for (;;)
+    switch (c = read_key (e))
+      {
+      case EOF:
+	return LINE_EDIT_EOF;
+      case '\n':
+      case '\r':
+	DSappendcstr (e->screen, "\r\n", NPOS);
+	/* Enter straight away leaves the line alone, as in MS-DOS */
+	return DSlength (e->line) == 0 && e->tat == 0
+	  ? LINE_EDIT_KEEP : LINE_EDIT_DONE;
+      case CONTROL ('C'):
+	DSappendcstr (e->screen, "^C\r\n", NPOS);
+	return LINE_EDIT_KEEP;
+      case CONTROL ('D'):
+	if (DSlength (e->line) == 0 && e->tat == 0)
+	  {
+	    DSappendcstr (e->screen, "\r\n", NPOS);
+	    return LINE_EDIT_EOF;
+	  }
+	break;
+      case KEY_ESC:
+	DSappendcstr (e->screen, "\\\r\n", NPOS);
+	start (e);
+	break;
+      case KEY_F1:
+      case KEY_RIGHT:
+	copy (e, e->tat < e->tlen ? e->tat + 1 : e->tlen);
+	break;
+      case KEY_F2:
+	/* copy up to the next of the character typed after F2 */
+	if ((c = read_key (e)) == EOF)
+	  return LINE_EDIT_EOF;
+	if (c < 0x100 && e->tat + 1 < e->tlen
+	    && (found = memchr (e->tmpl + e->tat + 1, c,
+				e->tlen - e->tat - 1)) != 0)
+	  copy (e, (size_t) (found - e->tmpl));
+	break;
+      case KEY_F3:
+	copy (e, e->tlen);
+	break;
+      case KEY_DEL:
+	if (e->tat < e->tlen)
+	  e->tat++;
+	break;
+      case KEY_INS:
+	e->insert = !e->insert;
+	break;
+      case KEY_LEFT:
+      case '\b':
+      case 0x7F:
+	rub_out (e);
+	break;
+      case KEY_OTHER:
+	break;
+      case CONTROL ('V'):
+	/* the next key goes in as it is */
+	if ((c = next_byte (e, 1)) == EOF)
+	  return LINE_EDIT_EOF;
+	/* fall through */
+      default:
+	if (e->insert || e->tat == e->tlen)
+	  put_char (e, c, 0);
+	else
+	  {
+	    put_char (e, c, 1);
+	    e->tat++;
+	  }
+	break;
+      }
+}
+
+#endif /* RAW_TERMINAL */
+
+/* line_edit_ready - can lines be edited with a template here? */
+int
+line_edit_ready (void)
+{
+#ifdef RAW_TERMINAL
+  char *term = getenv ("TERM");
+
+  return isatty (0) && isatty (1) && tcgetattr (0, &cooked) == 0
+    && (term == 0 || strcmp (term, "dumb") != 0);
+#else
+  return 0;
+#endif
+}
+
+/* line_edit - let the user edit a line, with tmpl as the template */
+int
+line_edit (char *prompt, const char *tmpl, size_t n, STRING_T * out)
+{
+#ifdef RAW_TERMINAL
+  struct termios raw;
+  EDITOR e;
+  int r;
+#ifdef TIOCGWINSZ
+  struct winsize ws;
+#endif
+
+  fflush (stdout);
+  if (tcgetattr (0, &cooked) != 0)
+    return LINE_EDIT_EOF;
+  raw = cooked;
+  raw.c_lflag &= ~(ICANON | ECHO | ISIG | IEXTEN);
+  raw.c_iflag &= ~IXON;
+  raw.c_cc[VMIN] = 1;
+  raw.c_cc[VTIME] = 0;
+  tcsetattr (0, TCSADRAIN, &raw);
+  e.prompt = prompt;
+  e.tmpl = tmpl;
+  e.tlen = n;
+  e.line = out;
+  e.cells = DScreate ();
+  e.screen = DScreate ();
+  e.width = DEFAULT_WIDTH;
+#ifdef TIOCGWINSZ
+  if (ioctl (1, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0)
+    e.width = ws.ws_col;
+#endif
+  r = edit (&e);
+  flush (&e);
+  tcsetattr (0, TCSADRAIN, &cooked);
+  DSdestroy (e.cells);
+  DSdestroy (e.screen);
+  return r;
+#else
+  return LINE_EDIT_EOF;
+#endif
+}
+
+/* line_edit_getc - getchar, after any keys line_edit read ahead */
+int
+line_edit_getc (void)
+{
+#ifdef RAW_TERMINAL
+  if (in_at < in_len)
+    return (unsigned char) in[in_at++];
+#endif
+  return getchar ();
+}
+
+/* END OF FILE */
@@ -0,0 +1,58 @@
+/* lineedit.h -- editing a line from the keyboard, with a template
+
+  DESCRIPTION:
+
+  This file contains the interface to the line editor behind edlin's
+  # command.  As in MS-DOS, the old line is the template: F1 (or the
+  right arrow) copies one character of it, F2 copies it up to a given
+  character, F3 copies the rest, Del skips a character of it and Ins
+  switches between typing over it and typing in front of it.  The editor
+  needs a terminal it can put into raw mode; where there is none, the
+  line is read the usual way.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+#ifndef LINEEDIT_H
+#define LINEEDIT_H
+
+#include <stddef.h>
+#include "dynstr.h"
+
+/* macros */
+
+/* what line_edit returns */
+#define LINE_EDIT_EOF   (-1)    /* the input has run out */
+#define LINE_EDIT_KEEP  0       /* leave the line as it was */
+#define LINE_EDIT_DONE  1       /* the new line is in out */
+
+/* functions */
+
+/* can lines be edited with a template here?  Only if both the standard
+   input and the standard output are a terminal. */
+int line_edit_ready (void);
+
+/* write prompt and let the user edit the n characters at tmpl, putting
+   the result into out */
+int line_edit (char *prompt, const char *tmpl, size_t n, STRING_T * out);
+
+/* getchar, except that keys read ahead by line_edit come first */
+int line_edit_getc (void);
+
+#endif
+
+/* END OF FILE */
@@ -37,7 +37,7 @@
 #define G00017  "[#][,#]d          delete                [#][,#][?]r$,$    replace"
 #define G00018  "e<>               end (write & quit)    [#][,#][?]s$      search"
 #define G00019  "[#]i              insert                [#]t<>            transfer"
-#define G00020  "[#][,#]l          list                  [#]w<>            write\n"
+#define G00020  "[#][,#]l          list                  [#]w<>            write"
 #define G00021  "where $ above is a string, <> is a filename,"
 #define G00022  "# is a number (which may be .=current line, $=last line,"
 #define G00023  "or either number + or - another number).\n"
@@ -57,6 +57,38 @@
 #define G00037  "ERROR: %s\n"
 #define G00038	"New file."
 #define G00039	"Abort edit (Y/N)? "
+#define G00040	"[%d] running\n"
+#define G00041	"[%d] %lu lines, %lu words, %lu characters\n"
+#define G00042	"[%d] checksum %lu, %lu characters\n"
+#define G00043	"[%d] %s: no differences\n"
+#define G00044	"[%d] %s: %lu lines differ, first at line %lu\n"
+#define G00045	"[%d] %s: cannot open\n"
+#define G00046	"[#][,#]bc         count                 [#][,#]bk         checksum"
+#define G00047	"[#][,#]bd<>       compare with file     #,#w[>>]<>        write lines"
+#define G00048	"%s: cannot open\n"
+#define G00049	"%s: written\n"
+#define G00050	"%s: unchanged\n"
+#define G00051	"%s: failed\n"
+#define G00052	"%lu files: %lu written, %lu unchanged, %lu failed\n"
+#define G00053	"f$,<>...          find in files         [#]g              go to found line"
+#define G00054	"%lu: %s:%lu: "
+#define G00055	"Mark not set"
+#define G00056	"'%c: %lu\n"
+#define G00057	"[#]kx             mark line as x        'x                line marked x\n"
+#define G00058	"Interrupted"
+#define G00059	"%3lu%% of %lu %s, %lu %s/s, %lu:%02lu left"
+#define G00060	"%lu %s, %lu %s/s"
+#define G00061	"lines"
+#define G00062	"bytes"
+#define G00063	"%lu lines changed\n"
+#define G00064	"[#][,#]nu         upper case            [#][,#]nl         lower case"
+#define G00065	"[#][,#]nt         trim blanks at end    [#][,#]ne[#]      tabs to spaces"
+#define G00066	"[#][,#]nc[#]      leading blanks to tabs"
+#define G00067	"[%d] %lu numbers, sum %.15g, smallest %.15g, largest %.15g, average %.15g, %lu bad\n"
+#define G00068	"[%d] no numbers, %lu bad\n"
+#define G00069	"[#][,#]ba[#][d]   sum of a column"
+#define G00070	"%s: not a session, or the file it was saved from has changed\n"
+#define G00071	"zw<>              save session          zr<>              resume session"
 
 #endif
 
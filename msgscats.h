@@ -43,7 +43,7 @@
 #define G00017  catgets(the_cat, 1, 17, "[#][,#]d          delete                [#][,#][?]r$,$    replace")
 #define G00018  catgets(the_cat, 1, 18, "e<>               end (write & quit)    [#][,#][?]s$      search")
 #define G00019  catgets(the_cat, 1, 19, "[#]i              insert                [#]t<>            transfer")
-#define G00020  catgets(the_cat, 1, 20, "[#][,#]l          list                  [#]w<>            write\n")
+#define G00020  catgets(the_cat, 1, 20, "[#][,#]l          list                  [#]w<>            write")
 #define G00021  catgets(the_cat, 1, 21, "where $ above is a string, <> is a filename,")
 #define G00022  catgets(the_cat, 1, 22, "# is a number (which may be .=current line, $=last line,")
 #define G00023  catgets(the_cat, 1, 23, "or either number + or - another number).\n")
@@ -63,6 +63,38 @@
 #define G00037  catgets(the_cat, 1, 37, "ERROR: %s\n")
 #define G00038	catgets(the_cat, 1, 38, "New file.")
 #define G00039	catgets(the_cat, 1, 39, "Abort edit (Y/N)? ")
+#define G00040	catgets(the_cat, 1, 40, "[%d] running\n")
+#define G00041	catgets(the_cat, 1, 41, "[%d] %lu lines, %lu words, %lu characters\n")
+#define G00042	catgets(the_cat, 1, 42, "[%d] checksum %lu, %lu characters\n")
+#define G00043	catgets(the_cat, 1, 43, "[%d] %s: no differences\n")
+#define G00044	catgets(the_cat, 1, 44, "[%d] %s: %lu lines differ, first at line %lu\n")
+#define G00045	catgets(the_cat, 1, 45, "[%d] %s: cannot open\n")
+#define G00046	catgets(the_cat, 1, 46, "[#][,#]bc         count                 [#][,#]bk         checksum")
+#define G00047	catgets(the_cat, 1, 47, "[#][,#]bd<>       compare with file     #,#w[>>]<>        write lines")
+#define G00048	catgets(the_cat, 1, 48, "%s: cannot open\n")
+#define G00049	catgets(the_cat, 1, 49, "%s: written\n")
+#define G00050	catgets(the_cat, 1, 50, "%s: unchanged\n")
+#define G00051	catgets(the_cat, 1, 51, "%s: failed\n")
+#define G00052	catgets(the_cat, 1, 52, "%lu files: %lu written, %lu unchanged, %lu failed\n")
+#define G00053	catgets(the_cat, 1, 53, "f$,<>...          find in files         [#]g              go to found line")
+#define G00054	catgets(the_cat, 1, 54, "%lu: %s:%lu: ")
+#define G00055	catgets(the_cat, 1, 55, "Mark not set")
+#define G00056	catgets(the_cat, 1, 56, "'%c: %lu\n")
+#define G00057	catgets(the_cat, 1, 57, "[#]kx             mark line as x        'x                line marked x\n")
+#define G00058	catgets(the_cat, 1, 58, "Interrupted")
+#define G00059	catgets(the_cat, 1, 59, "%3lu%% of %lu %s, %lu %s/s, %lu:%02lu left")
+#define G00060	catgets(the_cat, 1, 60, "%lu %s, %lu %s/s")
+#define G00061	catgets(the_cat, 1, 61, "lines")
+#define G00062	catgets(the_cat, 1, 62, "bytes")
+#define G00063	catgets(the_cat, 1, 63, "%lu lines changed\n")
+#define G00064	catgets(the_cat, 1, 64, "[#][,#]nu         upper case            [#][,#]nl         lower case")
+#define G00065	catgets(the_cat, 1, 65, "[#][,#]nt         trim blanks at end    [#][,#]ne[#]      tabs to spaces")
+#define G00066	catgets(the_cat, 1, 66, "[#][,#]nc[#]      leading blanks to tabs")
+#define G00067	catgets(the_cat, 1, 67, "[%d] %lu numbers, sum %.15g, smallest %.15g, largest %.15g, average %.15g, %lu bad\n")
+#define G00068	catgets(the_cat, 1, 68, "[%d] no numbers, %lu bad\n")
+#define G00069	catgets(the_cat, 1, 69, "[#][,#]ba[#][d]   sum of a column")
+#define G00070	catgets(the_cat, 1, 70, "%s: not a session, or the file it was saved from has changed\n")
+#define G00071	catgets(the_cat, 1, 71, "zw<>              save session          zr<>              resume session")
 
 
 #ifndef EXTERN
@@ -0,0 +1,153 @@
+/* norm.c -- tidying up the characters of a line
+
+  DESCRIPTION:
+
+  This file contains the line tidying behind edlin's n command.  Case
+  is changed a word at a time: adding a constant to each byte of a word
+  with its top bit cleared sets the top bit of every byte at or past
+  some letter, without any byte carrying into the next, so two such
+  sums pick out the bytes from A to Z (or a to z) in a handful of word
+  operations, and the case bit of each can then be flipped at once.
+  Finding tabs is left to memchr, which the C library already does a
+  word or more at a time.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+/* includes */
+
+#include "config.h"
+#include <limits.h>
+#ifdef HAVE_MEMORY_H
+#include <memory.h>
+#endif
+#include <string.h>
+#include "defines.h"
+#include "dynstr.h"
+#include "norm.h"
+
+/* macros */
+
+#if UCHAR_MAX != 0xFF
+#error char is not 8 bits wide
+#endif
+
+/* a one in every byte of a word, and the top bit of every byte */
+#define ONES            (~0UL / 0xFF)
+#define HIGHS           (ONES * 0x80)
+
+/* the bit that tells upper case from lower case in ASCII */
+#define CASE_BIT        0x20
+
+#define IS_BLANK(c)     ((c) == ' ' || (c) == '\t' || (c) == '\r' \
+			 || (c) == '\f' || (c) == '\v')
+
+/* functions */
+
+/* letters - the top bit of every byte of x from lo to hi, which are
+   both below 0x80 */
+static unsigned long
+letters (unsigned long x, int lo, int hi)
+{
+  unsigned long low7 = x & ~HIGHS;
+  unsigned long from_lo = low7 + ONES * (unsigned long) (0x80 - lo);
+  unsigned long past_hi = low7 + ONES * (unsigned long) (0x7F - hi);
+
+  return from_lo & ~past_hi & ~x & HIGHS;
+}
+
+/* norm_case - change the case of the letters in s */
+int
+norm_case (char *s, size_t n, int upper)
+{
+  int lo = upper ? 'a' : 'A', hi = upper ? 'z' : 'Z', changed = 0;
+  unsigned long w, m;
+  char *e = s + n;
+
+  for (; (size_t) (e - s) >= sizeof w; s += sizeof w)
+    {
+      memcpy (&w, s, sizeof w);
+      if ((m = letters (w, lo, hi)) != 0)
+	{
+	  w ^= m >> 2;          /* 0x80 >> 2 is the case bit */
+	  memcpy (s, &w, sizeof w);
+	  changed = 1;
+	}
+    }
+  for (; s < e; ++s)
+    if (*s >= lo && *s <= hi)
+      {
+	*s ^= CASE_BIT;
+	changed = 1;
+      }
+  return changed;
+}
+
+/* norm_trim - how long s is without its trailing blanks */
+size_t
+norm_trim (const char *s, size_t n)
+{
+  while (n > 0 && IS_BLANK (s[n - 1]))
+    n--;
+  return n;
+}
+
+/* norm_expand - turn the tabs in s into spaces */
+int
+norm_expand (STRING_T * out, const char *s, size_t n, unsigned tabs)
+{
+  const char *e = s + n, *t;
+  size_t col = 0;
+
+  if ((t = memchr (s, '\t', n)) == 0)
+    return 0;
+  DSresize (out, 0, 0);
+  do
+    {
+      DSappendcstr (out, (char *) s, t - s);
+      col += t - s;
+      DSappendchar (out, ' ', tabs - col % tabs);
+      col += tabs - col % tabs;
+      s = t + 1;
+    }
+  while ((t = memchr (s, '\t', e - s)) != 0);
+  DSappendcstr (out, (char *) s, e - s);
+  return 1;
+}
+
+/* norm_collapse - turn the blanks s starts with into tabs */
+int
+norm_collapse (STRING_T * out, const char *s, size_t n, unsigned tabs)
+{
+  size_t i, col = 0, ntabs, nspaces;
+
+  for (i = 0; i < n && (s[i] == ' ' || s[i] == '\t'); ++i)
+    col = s[i] == '\t' ? col + tabs - col % tabs : col + 1;
+  ntabs = col / tabs;
+  nspaces = col % tabs;
+  /* already as it would be? */
+  if (i == ntabs + nspaces && memchr (s, ' ', ntabs) == 0
+      && memchr (s + ntabs, '\t', nspaces) == 0)
+    return 0;
+  DSresize (out, 0, 0);
+  DSappendchar (out, '\t', ntabs);
+  DSappendchar (out, ' ', nspaces);
+  DSappendcstr (out, (char *) s + i, n - i);
+  return 1;
+}
+
+/* END OF FILE */
@@ -0,0 +1,69 @@
+/* norm.h -- tidying up the characters of a line
+
+  DESCRIPTION:
+
+  This file contains the interface to the line tidying behind edlin's
+  n command: changing the case of letters, trimming blanks off the end
+  of a line, and turning tabs into spaces or leading spaces into tabs.
+  Each of them says whether the line needs changing at all before
+  anything is written, so that lines that are already tidy are left
+  alone; none of them keeps any state, so any number of threads can use
+  them at once.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+#ifndef NORM_H
+#define NORM_H
+
+#include <stddef.h>
+#include "dynstr.h"
+
+/* macros */
+
+/* what to do to a line, as given to the n command */
+#define NORM_UPPER      'u'     /* letters to upper case */
+#define NORM_LOWER      'l'     /* letters to lower case */
+#define NORM_TRIM       't'     /* drop blanks at the end */
+#define NORM_EXPAND     'e'     /* tabs to spaces */
+#define NORM_COLLAPSE   'c'     /* leading blanks to tabs */
+
+/* functions */
+
+/* change the letters A to Z among the n characters at s to upper case
+   (or lower case, if upper is zero), where they are; returns nonzero if
+   any were changed.  Only the words that hold such a letter are written
+   to. */
+int norm_case (char *s, size_t n, int upper);
+
+/* how long the n characters at s are without the blanks at the end */
+size_t norm_trim (const char *s, size_t n);
+
+/* put the n characters at s, with every tab turned into spaces up to
+   the next multiple of tabs columns, into out; returns zero, leaving out
+   alone, if there are no tabs */
+int norm_expand (STRING_T * out, const char *s, size_t n, unsigned tabs);
+
+/* put the n characters at s, with the blanks they start with turned
+   into as many tabs (at every tabs columns) and as few spaces as will
+   reach the same column, into out; returns zero, leaving out alone, if
+   that would not change anything */
+int norm_collapse (STRING_T * out, const char *s, size_t n, unsigned tabs);
+
+#endif
+
+/* END OF FILE */
@@ -54,7 +54,7 @@ set FLAGS1=-i%WATCOM%\h -fi=nl_types.h -dUSE_CATGETS -zq -ox -bt=dos -mf
 set MYCC=wcc386
 
 :compile
-for %%f in (catgets defines dynstr edlib edlin) do %MYCC% %%f.c %FLAGS1%
+for %%f in (batch cancel catgets defines dynstr edlib edlin fileio find fuzzy json lineedit norm pool query uring zio) do %MYCC% %%f.c %FLAGS1%
 
 REM EDLIN32 uses DOS/4GW by default:
 REM   http://www.ibiblio.org/pub/micro/pc-stuff/freedos/files/devel/c/
@@ -68,7 +68,7 @@ REM Other DOS extenders will work too but haven't been tested by me (yet).
 set W1=dos4g name edlin32
 if not "%1"=="/32" set W1=dos name edlin16
 
-wlink system %W1% file catgets,defines,dynstr,edlib,edlin
+wlink system %W1% file batch,cancel,catgets,defines,dynstr,edlib,edlin,fileio,find,fuzzy,json,lineedit,norm,pool,query,uring,zio
 
 :end
 set FLAGS1=
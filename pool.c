@@ -0,0 +1,609 @@
+/* pool.c -- shared worker thread pool for edlin
+
+  DESCRIPTION:
+
+  This file contains the process-wide worker pool.  Each worker owns a
+  deque of line ranges.  A worker splits the range it is working on in
+  half, keeps the lower half and pushes the upper half onto the bottom
+  of its own deque; idle workers steal from the top of somebody else's
+  deque, so they pick up the biggest pieces that are left.  The thread
+  that starts a job works on it too, as worker 0.
+
+  Helper threads for pool_spawn are kept around after their task is
+  done, so that the next command that needs one does not have to pay
+  for creating a thread again.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+/* includes */
+
+#include "config.h"
+#include <stdio.h>
+#include <stdlib.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>		/* need sysconf */
+#endif
+#ifdef HAVE_PTHREAD_H
+#include <pthread.h>
+#endif
+#include "defines.h"
+#include "pool.h"
+
+/* macros */
+
+/* How many ranges a worker's deque can hold.  Splitting in halves never
+   needs more than one entry per bit of an unsigned long.  */
+#define DEQUE_SIZE      128
+
+/* static variables */
+
+static unsigned pool_threads = 1;
+
+/* functions */
+
+/* run_serial - do the work in the calling thread, a grain at a time */
+static unsigned long
+run_serial (unsigned long first, unsigned long last, unsigned long grain,
+	    pool_range_fn * range_fn, pool_find_fn * find_fn, void *arg)
+{
+  unsigned long next, found;
+
+  for (; first < last; first = next)
+    {
+      next = first - first % grain + grain;
+      if (next > last)
+	next = last;
+      if (find_fn)
+	{
+	  if ((found = find_fn (arg, first, next)) != POOL_NONE)
+	    return found;
+	}
+      else
+	range_fn (arg, first, next);
+    }
+  return POOL_NONE;
+}
+
+#ifdef HAVE_PTHREAD_H
+
+/* typedefs */
+
+typedef struct RANGE
+{
+  unsigned long first, last;
+} RANGE;
+
+/* A worker and its deque.  The owner pushes and pops at the bottom,
+   thieves take from the top.  */
+typedef struct WORKER
+{
+  pthread_t thread;
+  RANGE deque[DEQUE_SIZE];
+  size_t top, bottom;
+} WORKER;
+
+/* A helper thread for pool_spawn.  */
+enum task_state
+{
+  task_idle,
+  task_running,
+  task_done
+};
+
+struct POOL_TASK
+{
+  pthread_t thread;
+  pthread_cond_t cond;
+  pool_task_fn *fn;
+  void *arg;
+  enum task_state state;
+  POOL_TASK *next;
+};
+
+/* Something a helper task and its caller wait for each other on.  */
+struct POOL_EVENT
+{
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+};
+
+/* static variables */
+
+/* pool_lock protects everything below.  */
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pool_wake = PTHREAD_COND_INITIALIZER;
+static WORKER workers[POOL_MAX_THREADS];
+static unsigned workers_started = 1;	/* worker 0 is the caller */
+static int shutting_down = 0;
+static POOL_TASK *helpers = 0;
+
+/* the job that is being worked on */
+static struct
+{
+  int active;
+  pool_range_fn *range_fn;
+  pool_find_fn *find_fn;
+  void *arg;
+  unsigned long grain;
+  unsigned long remaining;	/* lines not done yet */
+  unsigned long found;		/* lowest line found so far */
+} job;
+
+/* take_work - pop from our own deque, or steal from another one.
+   Called with pool_lock held.  */
+static int
+take_work (unsigned self, RANGE * r)
+{
+  WORKER *w = workers + self;
+  unsigned i;
+
+  if (w->bottom != w->top)
+    {
+      *r = w->deque[--w->bottom % DEQUE_SIZE];
+      return 1;
+    }
+  for (i = 1; i < workers_started; ++i)
+    {
+      w = workers + (self + i) % workers_started;
+      if (w->bottom != w->top)
+	{
+	  *r = w->deque[w->top++ % DEQUE_SIZE];
+	  return 1;
+	}
+    }
+  return 0;
+}
+
+/* run_piece - split a range down to the grain size, pushing the upper
+   halves for other workers to steal, then do the lower half.  A range
+   bigger than the grain always has a multiple of the grain inside it,
+   and it is split on the one nearest the middle.  */
+static void
+run_piece (unsigned self, unsigned long first, unsigned long last)
+{
+  WORKER *w = workers + self;
+  unsigned long mid, lo, found = POOL_NONE;
+  int pushed = 0, skip;
+
+  pthread_mutex_lock (&pool_lock);
+  while (last - first > job.grain && w->bottom - w->top < DEQUE_SIZE)
+    {
+      mid = first + (last - first) / 2;
+      lo = mid - mid % job.grain;
+      if (lo > first && (mid - lo <= lo + job.grain - mid
+			 || lo + job.grain >= last))
+	mid = lo;
+      else if (lo + job.grain < last)
+	mid = lo + job.grain;
+      w->deque[w->bottom % DEQUE_SIZE].first = mid;
+      w->deque[w->bottom++ % DEQUE_SIZE].last = last;
+      last = mid;
+      pushed = 1;
+    }
+  if (pushed)
+    pthread_cond_broadcast (&pool_wake);
+  /* nothing past a line that has already been found matters */
+  skip = job.find_fn != 0 && first >= job.found;
+  pthread_mutex_unlock (&pool_lock);
+  if (!skip)
+    {
+      if (job.find_fn)
+	found = job.find_fn (job.arg, first, last);
+      else
+	job.range_fn (job.arg, first, last);
+    }
+  pthread_mutex_lock (&pool_lock);
+  if (found < job.found)
+    job.found = found;
+  job.remaining -= last - first;
+  if (job.remaining == 0)
+    pthread_cond_broadcast (&pool_wake);
+  pthread_mutex_unlock (&pool_lock);
+}
+
+/* participate - work on the current job until it is finished.  Called
+   and returns with pool_lock held.  */
+static void
+participate (unsigned self)
+{
+  RANGE r;
+
+  while (job.remaining > 0)
+    {
+      if (take_work (self, &r))
+	{
+	  pthread_mutex_unlock (&pool_lock);
+	  run_piece (self, r.first, r.last);
+	  pthread_mutex_lock (&pool_lock);
+	}
+      else
+	pthread_cond_wait (&pool_wake, &pool_lock);
+    }
+}
+
+/* worker_main - the main loop of a worker thread */
+static void *
+worker_main (void *p)
+{
+  unsigned self = (unsigned) ((WORKER *) p - workers);
+
+  pthread_mutex_lock (&pool_lock);
+  for (;;)
+    {
+      while (!shutting_down && !(job.active && job.remaining > 0))
+	pthread_cond_wait (&pool_wake, &pool_lock);
+      if (shutting_down)
+	break;
+      participate (self);
+    }
+  pthread_mutex_unlock (&pool_lock);
+  return 0;
+}
+
+/* start_workers - start the worker threads the first time they are
+   needed.  Called with pool_lock held.  */
+static void
+start_workers (void)
+{
+  while (workers_started < pool_threads)
+    {
+      WORKER *w = workers + workers_started;
+
+      w->top = w->bottom = 0;
+      if (pthread_create (&w->thread, 0, worker_main, w) != 0)
+	{
+	  /* make do with what we have */
+	  pool_threads = workers_started;
+	  break;
+	}
+      workers_started++;
+    }
+}
+
+/* pool_run - the common part of pool_for_range and pool_find_first */
+static unsigned long
+pool_run (unsigned long first, unsigned long last, unsigned long grain,
+	  pool_range_fn * range_fn, pool_find_fn * find_fn, void *arg)
+{
+  unsigned long found;
+
+  if (grain == 0)
+    grain = POOL_GRAIN;
+  if (last <= first)
+    return POOL_NONE;
+  pthread_mutex_lock (&pool_lock);
+  if (pool_threads < 2 || last - first <= grain || job.active)
+    {
+      /* too small to be worth it, or the pool is busy */
+      pthread_mutex_unlock (&pool_lock);
+      return run_serial (first, last, grain, range_fn, find_fn, arg);
+    }
+  start_workers ();
+  job.active = 1;
+  job.range_fn = range_fn;
+  job.find_fn = find_fn;
+  job.arg = arg;
+  job.grain = grain;
+  job.remaining = last - first;
+  job.found = POOL_NONE;
+  workers[0].top = workers[0].bottom = 0;
+  workers[0].deque[0].first = first;
+  workers[0].deque[0].last = last;
+  workers[0].bottom = 1;
+  pthread_cond_broadcast (&pool_wake);
+  participate (0);
+  found = job.found;
+  job.active = 0;
+  pthread_mutex_unlock (&pool_lock);
+  return found;
+}
+
+/* helper_main - the main loop of a pool_spawn helper thread */
+static void *
+helper_main (void *p)
+{
+  POOL_TASK *t = p;
+
+  pthread_mutex_lock (&pool_lock);
+  for (;;)
+    {
+      while (!shutting_down && t->state != task_running)
+	pthread_cond_wait (&t->cond, &pool_lock);
+      if (t->state != task_running)
+	break;
+      pthread_mutex_unlock (&pool_lock);
+      t->fn (t->arg);
+      pthread_mutex_lock (&pool_lock);
+      t->state = task_done;
+      pthread_cond_broadcast (&t->cond);
+    }
+  pthread_mutex_unlock (&pool_lock);
+  return 0;
+}
+
+/* pool_spawn - run fn (arg) on a helper thread */
+POOL_TASK *
+pool_spawn (pool_task_fn * fn, void *arg)
+{
+  POOL_TASK *t;
+
+  if (pool_threads < 2)
+    return 0;
+  pthread_mutex_lock (&pool_lock);
+  for (t = helpers; t != 0 && t->state != task_idle; t = t->next)
+    ;
+  if (t == 0)
+    {
+      if ((t = malloc (sizeof (POOL_TASK))) == 0)
+	Nomemory ();
+      t->state = task_idle;
+      pthread_cond_init (&t->cond, 0);
+      if (pthread_create (&t->thread, 0, helper_main, t) != 0)
+	{
+	  pthread_mutex_unlock (&pool_lock);
+	  pthread_cond_destroy (&t->cond);
+	  free (t);
+	  return 0;
+	}
+      t->next = helpers;
+      helpers = t;
+    }
+  t->fn = fn;
+  t->arg = arg;
+  t->state = task_running;
+  pthread_cond_broadcast (&t->cond);
+  pthread_mutex_unlock (&pool_lock);
+  return t;
+}
+
+/* pool_join - wait for a task to finish and give its thread back */
+void
+pool_join (POOL_TASK * t)
+{
+  if (t == 0)
+    return;
+  pthread_mutex_lock (&pool_lock);
+  while (t->state != task_done)
+    pthread_cond_wait (&t->cond, &pool_lock);
+  t->state = task_idle;
+  pthread_mutex_unlock (&pool_lock);
+}
+
+/* pool_event_create - make an event for a spawned task to wait on */
+POOL_EVENT *
+pool_event_create (void)
+{
+  POOL_EVENT *e;
+
+  if ((e = malloc (sizeof (POOL_EVENT))) == 0)
+	Nomemory ();
+  pthread_mutex_init (&e->lock, 0);
+  pthread_cond_init (&e->cond, 0);
+  return e;
+}
+
+/* pool_event_destroy - throw away an event */
+void
+pool_event_destroy (POOL_EVENT * e)
+{
+  if (e == 0)
+    return;
+  pthread_cond_destroy (&e->cond);
+  pthread_mutex_destroy (&e->lock);
+  free (e);
+}
+
+/* pool_event_wait - sleep until ready (arg) is true.  ready is called
+   with the event locked, so a pool_event_signal that follows a change
+   can never be missed.  */
+void
+pool_event_wait (POOL_EVENT * e, pool_ready_fn * ready, void *arg)
+{
+  if (ready (arg))
+    return;
+  pthread_mutex_lock (&e->lock);
+  while (!ready (arg))
+    pthread_cond_wait (&e->cond, &e->lock);
+  pthread_mutex_unlock (&e->lock);
+}
+
+/* pool_event_signal - wake everything waiting on an event */
+void
+pool_event_signal (POOL_EVENT * e)
+{
+  pthread_mutex_lock (&e->lock);
+  pthread_cond_broadcast (&e->cond);
+  pthread_mutex_unlock (&e->lock);
+}
+
+/* fork_prepare, fork_parent, fork_child - keep the pool usable in a
+   child process.  Only the forking thread exists in the child, so the
+   child starts over with no workers and no helpers.  */
+static void
+fork_prepare (void)
+{
+  pthread_mutex_lock (&pool_lock);
+}
+
+static void
+fork_parent (void)
+{
+  pthread_mutex_unlock (&pool_lock);
+}
+
+static void
+fork_child (void)
+{
+  pthread_cond_init (&pool_wake, 0);
+  workers_started = 1;
+  helpers = 0;
+  job.active = 0;
+  job.remaining = 0;
+  pthread_mutex_unlock (&pool_lock);
+}
+
+/* pool_destroy - stop all the threads in the pool */
+void
+pool_destroy (void)
+{
+  POOL_TASK *t;
+  unsigned i;
+
+  pthread_mutex_lock (&pool_lock);
+  shutting_down = 1;
+  pthread_cond_broadcast (&pool_wake);
+  for (t = helpers; t != 0; t = t->next)
+    pthread_cond_broadcast (&t->cond);
+  pthread_mutex_unlock (&pool_lock);
+  for (i = 1; i < workers_started; ++i)
+    pthread_join (workers[i].thread, 0);
+  while ((t = helpers) != 0)
+    {
+      helpers = t->next;
+      pthread_join (t->thread, 0);
+      pthread_cond_destroy (&t->cond);
+      free (t);
+    }
+  workers_started = 1;
+  shutting_down = 0;
+}
+
+#else /* !HAVE_PTHREAD_H */
+
+/* Without threads, everything runs in the caller.  */
+
+static unsigned long
+pool_run (unsigned long first, unsigned long last, unsigned long grain,
+	  pool_range_fn * range_fn, pool_find_fn * find_fn, void *arg)
+{
+  return run_serial (first, last, grain ? grain : POOL_GRAIN,
+		     range_fn, find_fn, arg);
+}
+
+POOL_TASK *
+pool_spawn (pool_task_fn * fn, void *arg)
+{
+  return 0;
+}
+
+void
+pool_join (POOL_TASK * t)
+{
+}
+
+/* Nothing can run alongside the caller, so whatever it waits for has
+   either happened already or never will.  */
+
+POOL_EVENT *
+pool_event_create (void)
+{
+  return 0;
+}
+
+void
+pool_event_destroy (POOL_EVENT * e)
+{
+}
+
+void
+pool_event_wait (POOL_EVENT * e, pool_ready_fn * ready, void *arg)
+{
+}
+
+void
+pool_event_signal (POOL_EVENT * e)
+{
+}
+
+void
+pool_destroy (void)
+{
+}
+
+#endif /* HAVE_PTHREAD_H */
+
+/* pool_init - decide how many threads to use */
+void
+pool_init (unsigned nthreads)
+{
+  char *env = getenv (POOL_ENV);
+  unsigned long n;
+
+  if (env != 0 && (n = strtoul (env, 0, 10)) > 0)
+    nthreads = (unsigned) (n < POOL_MAX_THREADS ? n : POOL_MAX_THREADS);
+#if defined(HAVE_SYSCONF) && defined(_SC_NPROCESSORS_ONLN)
+  if (nthreads == 0)
+    {
+      long cpus = sysconf (_SC_NPROCESSORS_ONLN);
+
+      nthreads = cpus > 0 ? (unsigned) cpus : 1;
+    }
+#endif
+  if (nthreads == 0)
+    nthreads = 1;
+  if (nthreads > POOL_MAX_THREADS)
+    nthreads = POOL_MAX_THREADS;
+#ifdef HAVE_PTHREAD_H
+  pool_threads = nthreads;
+  {
+    static int registered = 0;
+
+    if (!registered && pthread_atfork (fork_prepare, fork_parent,
+				       fork_child) == 0)
+      registered = 1;
+  }
+#else
+  pool_threads = 1;
+#endif
+}
+
+/* pool_size - how many threads take part in range work */
+unsigned
+pool_size (void)
+{
+  return pool_threads;
+}
+
+/* pool_limit - use no more than nthreads threads */
+void
+pool_limit (unsigned nthreads)
+{
+#ifdef HAVE_PTHREAD_H
+  if (nthreads > 0 && nthreads < pool_threads)
+    pool_threads = nthreads;
+#endif
+}
+
+/* pool_for_range - call fn on pieces of [first, last) */
+void
+pool_for_range (unsigned long first, unsigned long last,
+		unsigned long grain, pool_range_fn * fn, void *arg)
+{
+  pool_run (first, last, grain, fn, 0, arg);
+}
+
+/* pool_find_first - return the lowest line in [first, last) that fn
+   finds, or POOL_NONE */
+unsigned long
+pool_find_first (unsigned long first, unsigned long last,
+		 unsigned long grain, pool_find_fn * fn, void *arg)
+{
+  return pool_run (first, last, grain, 0, fn, arg);
+}
+
+/* END OF FILE */
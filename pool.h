@@ -0,0 +1,118 @@
+/* pool.h -- shared worker thread pool for edlin
+
+  DESCRIPTION:
+
+  This file contains the interface to the process-wide worker pool that
+  all parallel operations in edlin share.  Ranges of lines are handed to
+  the pool, which splits them into pieces and spreads the pieces across
+  the worker threads with per-worker work-stealing deques.  Long-running
+  helper tasks (readers, writers and the like) are started through
+  pool_spawn() so that thread creation stays in one place.
+
+  When the system has no thread support, every operation runs serially
+  in the calling thread and pool_spawn() refuses to start anything.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+#ifndef POOL_H
+#define POOL_H
+
+#include <stddef.h>
+
+/* macros */
+
+/* The largest number of threads the pool will run.  */
+#define POOL_MAX_THREADS        64
+
+/* The default number of lines a range is split down to.  */
+#define POOL_GRAIN              4096UL
+
+/* Returned by pool_find_first when nothing was found.  */
+#define POOL_NONE               ((unsigned long)(-1L))
+
+/* The environment variable that overrides the number of threads.  */
+#define POOL_ENV                "EDLIN_THREADS"
+
+/* typedefs */
+
+/* Work on the lines from first up to (but not including) last.  */
+typedef void pool_range_fn (void *arg, unsigned long first,
+                            unsigned long last);
+
+/* Return the first line from first up to (but not including) last that
+   matches, or POOL_NONE.  */
+typedef unsigned long pool_find_fn (void *arg, unsigned long first,
+                                    unsigned long last);
+
+/* A task run by pool_spawn.  */
+typedef void pool_task_fn (void *arg);
+
+typedef struct POOL_TASK POOL_TASK;
+
+/* Is whatever pool_event_wait waits for ready?  */
+typedef int pool_ready_fn (void *arg);
+
+typedef struct POOL_EVENT POOL_EVENT;
+
+/* functions */
+
+/* set up the pool; nthreads == 0 means one thread per processor.  The
+   POOL_ENV environment variable overrides nthreads.  */
+void pool_init (unsigned nthreads);
+
+/* stop all the threads in the pool */
+void pool_destroy (void);
+
+/* how many threads (including the caller) take part in range work? */
+unsigned pool_size (void);
+
+/* use no more than nthreads threads from now on; only for a process
+   that has not started any yet, such as a child just forked */
+void pool_limit (unsigned nthreads);
+
+/* call fn on pieces of [first, last) of about grain lines; every piece
+   starts and ends on a multiple of grain, or at first or last */
+void pool_for_range (unsigned long first, unsigned long last,
+                     unsigned long grain, pool_range_fn * fn, void *arg);
+
+/* return the lowest line in [first, last) that fn finds, or POOL_NONE;
+   the pieces fn is called on are cut up as for pool_for_range */
+unsigned long pool_find_first (unsigned long first, unsigned long last,
+                               unsigned long grain, pool_find_fn * fn,
+                               void *arg);
+
+/* run fn (arg) on a helper thread; returns a null pointer if no thread
+   could be started, in which case the caller has to do the work itself */
+POOL_TASK *pool_spawn (pool_task_fn * fn, void *arg);
+
+/* wait for a task started by pool_spawn to finish */
+void pool_join (POOL_TASK * task);
+
+/* events let a spawned task and its caller wait for each other */
+POOL_EVENT *pool_event_create (void);
+void pool_event_destroy (POOL_EVENT * event);
+
+/* sleep until ready (arg) returns nonzero */
+void pool_event_wait (POOL_EVENT * event, pool_ready_fn * ready, void *arg);
+
+/* wake whoever waits on event, after changing what ready looks at */
+void pool_event_signal (POOL_EVENT * event);
+
+#endif
+
+/* END OF FILE */
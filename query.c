@@ -0,0 +1,688 @@
+/* query.c -- read-only queries that run in the background
+
+  DESCRIPTION:
+
+  This file contains the read-only queries of edlin.  A query is run in
+  a forked child process, which gets a copy-on-write snapshot of the
+  whole buffer for free: the parent can go on changing lines while the
+  child reads the old ones, and neither has to wait for the other.  The
+  child writes its result down a pipe, and the parent prints whatever
+  has arrived each time it is about to prompt for a command.
+
+  The counting, checksumming and summing work is split into chunks of
+  lines that are handed to the worker pool.  Checksums of the chunks are
+  combined into the checksum of the whole range afterwards, and sums,
+  smallest and largest numbers likewise.  Summing finds its column with
+  memchr, and reads numbers of up to fifteen digits without strtod: the
+  digits make an exact double, and one multiplication or division by an
+  exact power of ten then rounds it correctly.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+/* includes */
+
+#include "config.h"
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>		/* need fork, pipe */
+#endif
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#endif
+#ifdef HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+#include <signal.h>
+#include "dynstr.h"
+#include "json.h"
+#include "msgs.h"
+#include "pool.h"
+#include "query.h"
+
+/* macros */
+
+#if defined(HAVE_FORK) && defined(HAVE_PIPE) && defined(HAVE_SYS_WAIT_H)
+#define QUERY_FORK
+#endif
+
+/* How many chunks per thread a range is cut into.  */
+#define CHUNKS_PER_THREAD       4
+
+/* The column summed when none is given, and what columns are split at.  */
+#define DEFAULT_FIELD           1
+#define DEFAULT_DELIM           ','
+
+#define IS_DIGIT(c)             ((unsigned) ((c) - '0') < 10)
+
+/* typedefs */
+
+/* a chunk of lines and what was found in it */
+typedef struct CHUNK
+{
+  unsigned long first, last;
+  unsigned long lines, words, chars;
+  unsigned long crc;
+  unsigned long numbers, bad;
+  double sum, min, max;
+} CHUNK;
+
+typedef struct CHUNK_JOB
+{
+  int op;
+  unsigned long field;		/* the column QUERY_SUM adds up */
+  int delim;			/* and what columns are split at */
+  CHUNK *chunks;
+} CHUNK_JOB;
+
+#ifdef QUERY_FORK
+/* a query running in a child process */
+typedef struct QUERY
+{
+  int id;
+  pid_t pid;
+  int fd;
+  STRING_T *out;
+  struct QUERY *next;
+} QUERY;
+#endif
+
+/* static variables */
+
+extern DAS_ARRAY_T *buffer;
+
+static int next_id = 1;
+static unsigned long crc_table[256];
+static const double powers_of_ten[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+  1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+#ifdef QUERY_FORK
+static QUERY *queries = 0;
+#endif
+
+/* functions */
+
+/* make_crc_table - build the table for the CRC-32 used by zip and gzip */
+static void
+make_crc_table (void)
+{
+  unsigned long c;
+  int n, k;
+
+  if (crc_table[1] != 0)
+    return;
+  for (n = 0; n < 256; n++)
+    {
+      c = (unsigned long) n;
+      for (k = 0; k < 8; k++)
+	c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+      crc_table[n] = c;
+    }
+}
+
+/* update_crc - run len bytes of s through the (uninverted) crc */
+static unsigned long
+update_crc (unsigned long crc, const unsigned char *s, size_t len)
+{
+  while (len--)
+    crc = crc_table[(crc ^ *s++) & 0xFF] ^ (crc >> 8);
+  return crc;
+}
+
+/* gf2_times, gf2_square, combine_crc - compute the CRC-32 of two blocks
+   put together from the CRC-32s of the blocks, as in zlib.  */
+static unsigned long
+gf2_times (unsigned long *mat, unsigned long vec)
+{
+  unsigned long sum = 0;
+
+  while (vec)
+    {
+      if (vec & 1)
+	sum ^= *mat;
+      vec >>= 1;
+      mat++;
+    }
+  return sum;
+}
+
+static void
+gf2_square (unsigned long *square, unsigned long *mat)
+{
+  int n;
+
+  for (n = 0; n < 32; n++)
+    square[n] = gf2_times (mat, mat[n]);
+}
+
+static unsigned long
+combine_crc (unsigned long crc1, unsigned long crc2, unsigned long len2)
+{
+  unsigned long even[32], odd[32], row;
+  int n;
+
+  if (len2 == 0)
+    return crc1;
+  odd[0] = 0xEDB88320UL;
+  for (n = 1, row = 1; n < 32; n++, row <<= 1)
+    odd[n] = row;
+  gf2_square (even, odd);
+  gf2_square (odd, even);
+  do
+    {
+      gf2_square (even, odd);
+      if (len2 & 1)
+	crc1 = gf2_times (even, crc1);
+      len2 >>= 1;
+      if (len2 == 0)
+	break;
+      gf2_square (odd, even);
+      if (len2 & 1)
+	crc1 = gf2_times (odd, crc1);
+      len2 >>= 1;
+    }
+  while (len2 != 0);
+  return crc1 ^ crc2;
+}
+
+/* parse_column - read the column number and delimiter at s, as in 3 or
+   2; or 4\t; returns zero if they make no sense */
+static int
+parse_column (char *s, unsigned long *field, int *delim)
+{
+  *field = DEFAULT_FIELD;
+  *delim = DEFAULT_DELIM;
+  if (IS_DIGIT (*s))
+    *field = strtoul (s, &s, 10);
+  if (*s == '\\' && s[1] == 't')
+    {
+      *delim = '\t';
+      s += 2;
+    }
+  else if (*s != '\0')
+    *delim = (unsigned char) *s++;
+  return *field != 0 && *s == '\0' && !IS_DIGIT (*delim);
+}
+
+/* find_column - find column field (counting from 1) of the n characters
+   at s, split at delim; returns where it starts and puts its length in
+   *len, or returns a null pointer if the line is too short */
+static const char *
+find_column (const char *s, size_t n, unsigned long field, int delim,
+	     size_t * len)
+{
+  const char *e = s + n, *p;
+
+  for (; field > 1; field--)
+    {
+      if ((p = memchr (s, delim, (size_t) (e - s))) == 0)
+	return 0;
+      s = p + 1;
+    }
+  p = memchr (s, delim, (size_t) (e - s));
+  *len = (size_t) ((p != 0 ? p : e) - s);
+  return s;
+}
+
+/* parse_number - read the number in the n characters at s, which may
+   have blanks or double quotes around it, into *x; returns zero if they
+   are not a number */
+static int
+parse_number (const char *s, size_t n, double *x)
+{
+  const char *e = s + n, *start;
+  double m = 0.0;
+  int neg = 0, digits = 0, scale = 0, exp = 0, exp_neg = 0;
+  char buf[64];
+
+  while (s < e && (*s == ' ' || *s == '\t'))
+    s++;
+  while (e > s && (e[-1] == ' ' || e[-1] == '\t' || e[-1] == '\r'))
+    e--;
+  if (e - s >= 2 && *s == '"' && e[-1] == '"')
+    {
+      s++;
+      e--;
+    }
+  start = s;
+  if (s < e && (*s == '-' || *s == '+'))
+    neg = *s++ == '-';
+  for (; s < e && IS_DIGIT (*s); s++, digits++)
+    m = m * 10.0 + (*s - '0');
+  if (s < e && *s == '.')
+    for (s++; s < e && IS_DIGIT (*s); s++, digits++, scale++)
+      m = m * 10.0 + (*s - '0');
+  if (digits == 0)
+    return 0;
+  if (s < e && (*s == 'e' || *s == 'E'))
+    {
+      if (++s < e && (*s == '-' || *s == '+'))
+	exp_neg = *s++ == '-';
+      if (s == e || !IS_DIGIT (*s))
+	return 0;
+      for (; s < e && IS_DIGIT (*s); s++)
+	if (exp < 10000)
+	  exp = exp * 10 + (*s - '0');
+    }
+  if (s != e)
+    return 0;
+  exp = (exp_neg ? -exp : exp) - scale;
+  if (digits <= 15 && exp >= -22 && exp <= 22)
+    {
+      /* both m and the power of ten are exact, so this rounds once */
+      m = exp < 0 ? m / powers_of_ten[-exp] : m * powers_of_ten[exp];
+      *x = neg ? -m : m;
+    }
+  else
+    {
+      if ((size_t) (e - start) >= sizeof buf)
+	return 0;
+      memcpy (buf, start, (size_t) (e - start));
+      buf[e - start] = '\0';
+      *x = strtod (buf, 0);
+    }
+  return 1;
+}
+
+/* do_chunks - pool_range_fn that counts, checksums or sums whole
+   chunks */
+static void
+do_chunks (void *arg, unsigned long first, unsigned long last)
+{
+  CHUNK_JOB *job = arg;
+  CHUNK *c;
+  STRING_T *s;
+  unsigned long line;
+  unsigned char *p, *e;
+  static unsigned char nl = '\n';
+  int in_word;
+  const char *col;
+  size_t len;
+  double x;
+
+  for (; first < last; first++)
+    {
+      c = job->chunks + first;
+      c->crc = 0xFFFFFFFFUL;
+      for (line = c->first; line < c->last; line++)
+	{
+	  if (line + 8 < c->last)
+	    DSprefetch (DAS_get_at (buffer, (size_t) line + 8));
+	  s = DAS_get_at (buffer, (size_t) line);
+	  p = (unsigned char *) DScstr (s);
+	  e = p + DSlength (s);
+	  c->lines++;
+	  c->chars += DSlength (s) + 1;
+	  if (job->op == QUERY_CHECKSUM)
+	    {
+	      c->crc = update_crc (c->crc, p, DSlength (s));
+	      c->crc = update_crc (c->crc, &nl, 1);
+	    }
+	  else if (job->op == QUERY_SUM)
+	    {
+	      if ((col = find_column ((char *) p, DSlength (s), job->field,
+				      job->delim, &len)) == 0
+		  || !parse_number (col, len, &x))
+		c->bad++;
+	      else
+		{
+		  if (c->numbers++ == 0 || x < c->min)
+		    c->min = x;
+		  if (c->numbers == 1 || x > c->max)
+		    c->max = x;
+		  c->sum += x;
+		}
+	    }
+	  else
+	    for (in_word = 0; p < e; p++)
+	      {
+		if (isspace (*p))
+		  in_word = 0;
+		else if (!in_word)
+		  {
+		    in_word = 1;
+		    c->words++;
+		  }
+	      }
+	}
+      c->crc = (c->crc ^ 0xFFFFFFFFUL) & 0xFFFFFFFFUL;
+    }
+}
+
+/* query_record - start a JSON record about query id in out */
+static void
+query_record (STRING_T * out, char *type, int id, int op)
+{
+  json_begin (out, type);
+  json_number (out, "id", (unsigned long) id);
+  json_string (out, "op", op == QUERY_COUNT ? "count"
+	       : op == QUERY_CHECKSUM ? "checksum"
+	       : op == QUERY_DIFF ? "diff" : "sum", NPOS);
+}
+
+/* count_lines - count, checksum or sum lines line1 through line2; arg
+   is the column to sum */
+static void
+count_lines (int id, int op, unsigned long line1, unsigned long line2,
+	     char *arg, STRING_T * out)
+{
+  CHUNK_JOB job;
+  CHUNK total;
+  unsigned long n, nchunks, i;
+  char msg[192];
+
+  make_crc_table ();
+  n = line2 - line1 + 1;
+  nchunks = (unsigned long) pool_size () * CHUNKS_PER_THREAD;
+  if (nchunks > n)
+    nchunks = n;
+  job.op = op;
+  if (op == QUERY_SUM)
+    parse_column (arg, &job.field, &job.delim);
+  job.chunks = calloc (nchunks, sizeof (CHUNK));
+  if (job.chunks == 0)
+    Nomemory ();
+  for (i = 0; i < nchunks; i++)
+    {
+      job.chunks[i].first = line1 + n / nchunks * i + (i < n % nchunks ? i
+						       : n % nchunks);
+      job.chunks[i].last = job.chunks[i].first + n / nchunks
+	+ (i < n % nchunks);
+    }
+  pool_for_range (0, nchunks, 1, do_chunks, &job);
+  memset (&total, 0, sizeof (CHUNK));
+  for (i = 0; i < nchunks; i++)
+    {
+      total.lines += job.chunks[i].lines;
+      total.words += job.chunks[i].words;
+      total.crc = combine_crc (total.crc, job.chunks[i].crc,
+			       job.chunks[i].chars);
+      total.chars += job.chunks[i].chars;
+      if (job.chunks[i].numbers != 0)
+	{
+	  if (total.numbers == 0 || job.chunks[i].min < total.min)
+	    total.min = job.chunks[i].min;
+	  if (total.numbers == 0 || job.chunks[i].max > total.max)
+	    total.max = job.chunks[i].max;
+	}
+      total.numbers += job.chunks[i].numbers;
+      total.bad += job.chunks[i].bad;
+      total.sum += job.chunks[i].sum;
+    }
+  free (job.chunks);
+  if (json_output)
+    {
+      query_record (out, "query_result", id, op);
+      if (op == QUERY_CHECKSUM)
+	json_number (out, "crc", total.crc);
+      else if (op == QUERY_SUM)
+	{
+	  json_number (out, "numbers", total.numbers);
+	  json_number (out, "bad", total.bad);
+	  if (total.numbers != 0)
+	    {
+	      json_real (out, "sum", total.sum);
+	      json_real (out, "min", total.min);
+	      json_real (out, "max", total.max);
+	      json_real (out, "mean", total.sum / total.numbers);
+	    }
+	}
+      else
+	{
+	  json_number (out, "lines", total.lines);
+	  json_number (out, "words", total.words);
+	}
+      if (op != QUERY_SUM)
+	json_number (out, "chars", total.chars);
+      json_end (out);
+      return;
+    }
+  if (op == QUERY_CHECKSUM)
+    sprintf (msg, G00042, id, total.crc, total.chars);
+  else if (op == QUERY_SUM && total.numbers == 0)
+    sprintf (msg, G00068, id, total.bad);
+  else if (op == QUERY_SUM)
+    sprintf (msg, G00067, id, total.numbers, total.sum, total.min,
+	     total.max, total.sum / total.numbers, total.bad);
+  else
+    sprintf (msg, G00041, id, total.lines, total.words, total.chars);
+  DSappendcstr (out, msg, NPOS);
+}
+
+/* diff_lines - compare lines line1 through line2 with a file */
+static void
+diff_lines (int id, unsigned long line1, unsigned long line2,
+	    char *filename, STRING_T * out)
+{
+  FILE *f;
+  STRING_T *s = DScreate ();
+  char buf[BUFSIZ];
+  char *msg = malloc (strlen (filename) + 128);
+  unsigned long line, differ = 0, first = 0;
+  int eof = 0;
+
+  if (msg == 0)
+    Nomemory ();
+  if ((f = fopen (filename, "r")) == 0)
+    {
+      if (json_output)
+	{
+	  query_record (out, "query_result", id, QUERY_DIFF);
+	  json_string (out, "file", filename, NPOS);
+	  json_string (out, "error", "cannot_open", NPOS);
+	  json_end (out);
+	}
+      else
+	sprintf (msg, G00045, id, filename);
+    }
+  else
+    {
+      for (line = line1; line <= line2 || !eof; line++)
+	{
+	  DSresize (s, 0, 0);
+	  while (!eof && fgets (buf, BUFSIZ, f) != 0)
+	    {
+	      DSappendcstr (s, buf, NPOS);
+	      if (DSget_at (s, DSlength (s) - 1) == '\n')
+		break;
+	    }
+	  if (DSlength (s) == 0)
+	    eof = 1;
+	  else if (DSget_at (s, DSlength (s) - 1) == '\n')
+	    DSresize (s, DSlength (s) - 1, 0);
+	  if (eof && line > line2)
+	    break;
+	  if (eof || line > line2
+	      || DScompare (DAS_get_at (buffer, (size_t) line), s, 0,
+			    NPOS) != 0)
+	    {
+	      if (differ++ == 0)
+		first = line + 1;
+	    }
+	}
+      fclose (f);
+      if (json_output)
+	{
+	  query_record (out, "query_result", id, QUERY_DIFF);
+	  json_string (out, "file", filename, NPOS);
+	  json_number (out, "differ", differ);
+	  if (differ != 0)
+	    json_number (out, "first", first);
+	  json_end (out);
+	}
+      else if (differ == 0)
+	sprintf (msg, G00043, id, filename);
+      else
+	sprintf (msg, G00044, id, filename, differ, first);
+    }
+  if (!json_output)
+    DSappendcstr (out, msg, NPOS);
+  free (msg);
+  DSdestroy (s);
+}
+
+/* run_query - run a query and put the result in out, which is empty */
+static void
+run_query (int id, int op, unsigned long line1, unsigned long line2,
+	   char *filename, STRING_T * out)
+{
+  if (op == QUERY_DIFF)
+    diff_lines (id, line1, line2, filename, out);
+  else
+    count_lines (id, op, line1, line2, filename, out);
+}
+
+/* query_start - start a query on lines line1 through line2 */
+void
+query_start (int op, unsigned long line1, unsigned long line2,
+	     char *filename)
+{
+  STRING_T *out;
+  int id, delim;
+  unsigned long field;
+#ifdef QUERY_FORK
+  QUERY *q;
+  int fds[2];
+  pid_t pid;
+  size_t done;
+  long n;
+#endif
+
+  if (line1 > line2 || line2 >= DAS_length (buffer))
+    {
+      json_puts ("error", "entry_error", G00003);
+      return;
+    }
+  if (op == QUERY_DIFF && (filename == 0 || *filename == '\0'))
+    {
+      /* No filename */
+      json_error ("no_filename", G00034);
+      return;
+    }
+  if (op == QUERY_SUM && !parse_column (filename, &field, &delim))
+    {
+      /* Error: Invalid user input */
+      json_error ("invalid_input", G00033);
+      return;
+    }
+  id = next_id++;
+#ifdef QUERY_FORK
+  fflush (stdout);
+  if (pipe (fds) == 0)
+    {
+      if ((pid = fork ()) == 0)
+	{
+	  /* the child: work on the snapshot, report, and go away; an
+	     interrupt is for the command in the parent, not for this */
+	  signal (SIGINT, SIG_IGN);
+	  close (fds[0]);
+	  out = DScreate ();
+	  run_query (id, op, line1, line2, filename, out);
+	  for (done = 0; done < DSlength (out); done += n)
+	    if ((n = write (fds[1], DScstr (out) + done,
+			    DSlength (out) - done)) <= 0)
+	      break;
+	  _exit (0);
+	}
+      close (fds[1]);
+      if (pid > 0)
+	{
+	  if ((q = malloc (sizeof (QUERY))) == 0)
+	    Nomemory ();
+#ifdef O_NONBLOCK
+	  fcntl (fds[0], F_SETFL, fcntl (fds[0], F_GETFL) | O_NONBLOCK);
+#endif
+	  q->id = id;
+	  q->pid = pid;
+	  q->fd = fds[0];
+	  q->out = DScreate ();
+	  q->next = queries;
+	  queries = q;
+	  if (json_output)
+	    {
+	      query_record (q->out, "query_started", id, op);
+	      json_end (q->out);
+	      fputs (DScstr (q->out), stdout);
+	      DSresize (q->out, 0, 0);
+	    }
+	  else
+	    printf (G00040, id);
+	  return;
+	}
+      close (fds[0]);
+    }
+#endif
+  /* no way to run it in the background, so do it now */
+  out = DScreate ();
+  run_query (id, op, line1, line2, filename, out);
+  fputs (DScstr (out), stdout);
+  DSdestroy (out);
+}
+
+/* query_poll - print the results of the queries that have finished */
+void
+query_poll (void)
+{
+#ifdef QUERY_FORK
+  QUERY *q, **pq;
+  char buf[BUFSIZ];
+  long n;
+
+  for (pq = &queries; (q = *pq) != 0;)
+    {
+      while ((n = read (q->fd, buf, BUFSIZ)) > 0)
+	DSappendcstr (q->out, buf, (size_t) n);
+      if (n != 0)
+	{
+	  /* still running */
+	  pq = &q->next;
+	  continue;
+	}
+      close (q->fd);
+      waitpid (q->pid, 0, 0);
+      fputs (DScstr (q->out), stdout);
+      *pq = q->next;
+      DSdestroy (q->out);
+      free (q);
+    }
+#endif
+}
+
+/* query_finish - throw away the queries that are still running */
+void
+query_finish (void)
+{
+#ifdef QUERY_FORK
+  QUERY *q;
+
+  while ((q = queries) != 0)
+    {
+      queries = q->next;
+      kill (q->pid, SIGTERM);
+      close (q->fd);
+      waitpid (q->pid, 0, 0);
+      DSdestroy (q->out);
+      free (q);
+    }
+#endif
+}
+
+/* END OF FILE */
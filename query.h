@@ -0,0 +1,57 @@
+/* query.h -- read-only queries that run in the background
+
+  DESCRIPTION:
+
+  This file contains the interface to the read-only queries of edlin
+  (counting, checksumming and comparing lines).  Where the system can
+  fork, a query runs in a child process that sees a copy-on-write
+  snapshot of the buffer as it was when the query was started, so the
+  user can go on editing while it runs; the result is printed at the
+  next command prompt.  Elsewhere, queries run right away.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+#ifndef QUERY_H
+#define QUERY_H
+
+/* macros */
+
+/* the queries */
+#define QUERY_COUNT     'c'     /* count lines, words and characters */
+#define QUERY_CHECKSUM  'k'     /* CRC-32 of the lines as they would be
+                                   written to a file */
+#define QUERY_DIFF      'd'     /* compare the lines with a file */
+#define QUERY_SUM       'a'     /* add up the numbers in a column */
+
+/* functions */
+
+/* start a query on lines line1 through line2 (zero-based); filename is
+   the file QUERY_DIFF compares with, or the column (and delimiter) that
+   QUERY_SUM adds up */
+void query_start (int op, unsigned long line1, unsigned long line2,
+                  char *filename);
+
+/* print the results of the queries that have finished */
+void query_poll (void);
+
+/* throw away the queries that are still running */
+void query_finish (void);
+
+#endif
+
+/* END OF FILE */
@@ -0,0 +1,136 @@
+#!/bin/sh
+# deferred.sh -- check that edlin -t edits a file just as edlin does
+#
+# usage: deferred.sh edlin [runs]
+#
+# Each run makes up a file and a script of commands from a seed, runs
+# the script over the file with and without -t, and compares what was
+# printed and what was written.  The scripts mix the commands that -t
+# defers (a, d, i and m) with the ones that make it rebuild the buffer
+# first (k, l, s, r, c, marks and text searches as addresses), and
+# delete ranges that run past the end of the buffer.
+
+edlin=$1
+runs=${2:-300}
+if test -z "$edlin"; then
+  echo "usage: $0 edlin [runs]" >&2
+  exit 2
+fi
+case $edlin in
+  /*) ;;
+  *) edlin=`pwd`/$edlin ;;
+esac
+tmp=${TMPDIR:-/tmp}/deferred.$$
+trap 'rm -rf "$tmp"' 0 1 2 15
+mkdir "$tmp" "$tmp/plain" "$tmp/deferred" || exit 1
+
+failed=0
+seed=1
+while test $seed -le $runs; do
+  awk -v seed=$seed -v dir="$tmp" '
+    function pick(lo, hi) { return lo + int(rand() * (hi - lo + 1)) }
+    BEGIN {
+      srand(seed);
+      n = pick(0, 60);
+      for (i = 0; i < n; i++)
+        print "line " i > (dir "/in.txt");
+      if (n == 0)
+        printf "" > (dir "/in.txt");
+      s = dir "/script";
+      k = 0;
+      # n is kept equal to the number of lines in the buffer, so that
+      # every command is one edlin takes; the text put in starts with
+      # an l, so that if it ever were taken as a command, it would only
+      # list lines
+      for (c = pick(1, 120); c > 0; c--) {
+        m = n > 0 ? n : 1;
+        a = pick(1, m);
+        b = pick(a, a + 5 < m ? a + 5 : m);
+        r = rand();
+        if (r < 0.22 && n > 0) {
+          print a "," b "d" > s;
+          n -= b - a + 1;
+        } else if (r < 0.38) {
+          t = pick(1, 3); k++;
+          print pick(1, n + 1) "i" > s;
+          for (j = 0; j < t; j++) print "line new " k "." j > s;
+          print "." > s;
+          n += t;
+        } else if (r < 0.46) {
+          t = pick(1, 2); k++;
+          print "a" > s;
+          for (j = 0; j < t; j++) print "line app " k "." j > s;
+          print "." > s;
+          n += t;
+        } else if (r < 0.62) {
+          print a "," b "," pick(1, n + 1) "m" > s;
+        } else if (r < 0.66 && n > 0) {
+          d = pick(1, n + 1);
+          if (d <= a || d > b) {
+            print a "," b "," d ",1c" > s;
+            n += b - a + 1;
+          }
+        } else if (r < 0.70) {
+          print a "k" substr("abc", pick(1, 3), 1) > s;
+        } else if (r < 0.74) {
+          print "'\''" substr("abc", pick(1, 3), 1) ",'\''" \
+            substr("abc", pick(1, 3), 1) "l" > s;
+        } else if (r < 0.78) {
+          print a "," b "l" > s;
+        } else if (r < 0.80) {
+          print "k" > s;
+        } else if (r < 0.84) {
+          print "/" pick(0, 9) "/,.+1l" > s;
+        } else if (r < 0.86) {
+          print "1,#s" pick(0, 9) > s;
+        } else if (r < 0.89) {
+          print a "," b "r" pick(0, 9) "," pick(0, 9) > s;
+        } else if (r < 0.92 && n > 0) {
+          # a range that runs past the end is cut short
+          print a "," a + pick(5, 20) "d" > s;
+          n = a - 1;
+        } else if (r < 0.96 && n > 0) {
+          # and one that starts just past it deletes nothing, while one
+          # that starts further out takes the last line, as edlin always
+          # has
+          a = n + pick(1, 3);
+          print a "," a + pick(0, 5) "d" > s;
+          if (a > n + 1)
+            n--;
+        } else if (r < 0.96) {
+          # an empty buffer has nothing to delete
+          print pick(1, 3) "," pick(3, 6) "d" > s;
+        } else if (n > 0) {
+          print a > s;
+          print "line edited " a > s;
+        }
+      }
+      print "k" > s;
+      print "1,#l" > s;
+      print "w out.txt" > s;
+      print "q" > s;
+      print "y" > s;
+    }' || exit 1
+  cp "$tmp/in.txt" "$tmp/plain/in.txt"
+  cp "$tmp/in.txt" "$tmp/deferred/in.txt"
+  # -j, since it never stops a long listing to wait for Enter
+  (cd "$tmp/plain" && "$edlin" -j in.txt < ../script > stdout 2>&1) \
+    || { echo "deferred.sh: seed $seed: edlin failed" >&2; failed=1; }
+  (cd "$tmp/deferred" && "$edlin" -j -t in.txt < ../script > stdout 2>&1) \
+    || { echo "deferred.sh: seed $seed: edlin -t failed" >&2; failed=1; }
+  # how far a slow command has got depends on the clock, not on -t
+  for d in plain deferred; do
+    grep -v '"type":"progress"' "$tmp/$d/stdout" > "$tmp/$d/printed"
+  done
+  for f in out.txt printed; do
+    if ! cmp -s "$tmp/plain/$f" "$tmp/deferred/$f"; then
+      echo "deferred.sh: seed $seed: $f differs with -t" >&2
+      failed=1
+    fi
+  done
+  seed=`expr $seed + 1`
+done
+if test $failed = 0; then
+  echo "deferred.sh: $runs runs, -t made no difference"
+fi
+exit $failed
@@ -0,0 +1,270 @@
+/* uring.c -- asynchronous bulk file I/O for edlin
+
+  DESCRIPTION:
+
+  This file contains a minimal io_uring driver.  The submission and
+  completion rings are mapped straight from the kernel and driven with
+  the raw io_uring_setup(), io_uring_enter() and io_uring_register()
+  system calls.  Only one thread at a time may use a ring.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+/* includes */
+
+#include "config.h"
+#include <stdlib.h>
+#include <string.h>
+#include "uring.h"
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_SYS_SYSCALL_H) \
+    && defined(HAVE_SYS_MMAN_H) && defined(HAVE_STDATOMIC_H)
+#define USE_URING
+#endif
+
+#ifdef USE_URING
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sys/uio.h>
+#include <linux/io_uring.h>
+
+/* typedefs */
+
+struct URING
+{
+  int fd;
+  int fixed;			/* are the buffers registered? */
+  char **bufs;
+  void *sq_map, *cq_map;
+  size_t sq_size, cq_size, sqes_size;
+  unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+  unsigned *cq_head, *cq_tail, *cq_mask;
+  struct io_uring_sqe *sqes;
+  struct io_uring_cqe *cqes;
+};
+
+/* functions */
+
+/* sys_setup, sys_enter, sys_register - the system calls */
+static int
+sys_setup (unsigned entries, struct io_uring_params *p)
+{
+  return (int) syscall (__NR_io_uring_setup, entries, p);
+}
+
+static int
+sys_enter (int fd, unsigned to_submit, unsigned min_complete,
+	   unsigned flags)
+{
+  return (int) syscall (__NR_io_uring_enter, fd, to_submit, min_complete,
+			flags, (void *) 0, (size_t) 0);
+}
+
+static int
+sys_register (int fd, unsigned op, void *arg, unsigned nargs)
+{
+  return (int) syscall (__NR_io_uring_register, fd, op, arg, nargs);
+}
+
+#define RING_AT(map, off)	((unsigned *) ((char *) (map) + (off)))
+
+/* how often to try handing a request to a busy kernel */
+#define ENTER_TRIES		16
+
+/* uring_create - set up a ring */
+URING *
+uring_create (char **bufs, unsigned nbufs, size_t size)
+{
+  struct io_uring_params p;
+  struct iovec *iov;
+  URING *u;
+  unsigned i;
+
+  memset (&p, 0, sizeof (p));
+  if ((u = malloc (sizeof (URING))) == 0)
+    return 0;
+  if ((u->fd = sys_setup (nbufs, &p)) < 0)
+    {
+      free (u);
+      return 0;
+    }
+  u->bufs = bufs;
+  u->sq_size = p.sq_off.array + p.sq_entries * sizeof (unsigned);
+  u->cq_size = p.cq_off.cqes + p.cq_entries * sizeof (struct io_uring_cqe);
+  u->sqes_size = p.sq_entries * sizeof (struct io_uring_sqe);
+  u->sq_map = mmap (0, u->sq_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQ_RING);
+  u->cq_map = mmap (0, u->cq_size, PROT_READ | PROT_WRITE,
+		    MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_CQ_RING);
+  u->sqes = mmap (0, u->sqes_size, PROT_READ | PROT_WRITE,
+		  MAP_SHARED | MAP_POPULATE, u->fd, IORING_OFF_SQES);
+  if (u->sq_map == MAP_FAILED || u->cq_map == MAP_FAILED
+      || u->sqes == MAP_FAILED)
+    {
+      if (u->sq_map != MAP_FAILED)
+	munmap (u->sq_map, u->sq_size);
+      if (u->cq_map != MAP_FAILED)
+	munmap (u->cq_map, u->cq_size);
+      if (u->sqes != MAP_FAILED)
+	munmap (u->sqes, u->sqes_size);
+      close (u->fd);
+      free (u);
+      return 0;
+    }
+  u->sq_head = RING_AT (u->sq_map, p.sq_off.head);
+  u->sq_tail = RING_AT (u->sq_map, p.sq_off.tail);
+  u->sq_mask = RING_AT (u->sq_map, p.sq_off.ring_mask);
+  u->sq_array = RING_AT (u->sq_map, p.sq_off.array);
+  u->cq_head = RING_AT (u->cq_map, p.cq_off.head);
+  u->cq_tail = RING_AT (u->cq_map, p.cq_off.tail);
+  u->cq_mask = RING_AT (u->cq_map, p.cq_off.ring_mask);
+  u->cqes = (struct io_uring_cqe *) ((char *) u->cq_map + p.cq_off.cqes);
+
+  /* Registered buffers save the kernel mapping the pages on every
+     request, but count against the locked memory limit; without them
+     the plain read and write operations are used.  */
+  u->fixed = 0;
+  if ((iov = malloc (nbufs * sizeof (struct iovec))) != 0)
+    {
+      for (i = 0; i < nbufs; ++i)
+	{
+	  iov[i].iov_base = bufs[i];
+	  iov[i].iov_len = size;
+	}
+      u->fixed = sys_register (u->fd, IORING_REGISTER_BUFFERS, iov,
+			       nbufs) == 0;
+      free (iov);
+    }
+  return u;
+}
+
+/* uring_destroy - tear a ring down */
+void
+uring_destroy (URING * u)
+{
+  if (u == 0)
+    return;
+  munmap (u->sqes, u->sqes_size);
+  munmap (u->cq_map, u->cq_size);
+  munmap (u->sq_map, u->sq_size);
+  close (u->fd);		/* this unregisters the buffers too */
+  free (u);
+}
+
+/* uring_start - queue one read or write and hand it to the kernel */
+int
+uring_start (URING * u, int fd, int write, unsigned i, size_t n,
+	     off_t off)
+{
+  unsigned tail = *u->sq_tail, slot = tail & *u->sq_mask;
+  struct io_uring_sqe *sqe = u->sqes + slot;
+  int r, tries;
+
+  memset (sqe, 0, sizeof (*sqe));
+  if (u->fixed)
+    {
+      sqe->opcode = write ? IORING_OP_WRITE_FIXED : IORING_OP_READ_FIXED;
+      sqe->buf_index = i;
+    }
+  else
+    sqe->opcode = write ? IORING_OP_WRITE : IORING_OP_READ;
+  sqe->fd = fd;
+  sqe->addr = (unsigned long) u->bufs[i];
+  sqe->len = n;
+  sqe->off = off;
+  sqe->user_data = i;
+  u->sq_array[slot] = slot;
+  atomic_store_explicit ((_Atomic unsigned *) u->sq_tail, tail + 1,
+			 memory_order_release);
+  /* Once the kernel has taken the entry, its completion will turn up
+     even if the request fails, so it is in flight whatever
+     io_uring_enter() said.  Until then it can be tried again.  */
+  for (tries = 0;; ++tries)
+    {
+      r = sys_enter (u->fd, 1, 0, 0);
+      if (atomic_load_explicit ((_Atomic unsigned *) u->sq_head,
+				memory_order_acquire) != tail)
+	return 0;
+      if (r >= 0 || (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+	  || tries == ENTER_TRIES)
+	break;
+    }
+  /* The kernel only looks at the ring inside io_uring_enter(), and no
+     one else calls it, so taking the entry back here is safe; the
+     caller then does the I/O itself.  */
+  atomic_store_explicit ((_Atomic unsigned *) u->sq_tail, tail,
+			 memory_order_release);
+  return 1;
+}
+
+/* uring_wait - wait for a request to finish */
+unsigned
+uring_wait (URING * u, long *res)
+{
+  unsigned head, i;
+  struct io_uring_cqe *cqe;
+
+  for (;;)
+    {
+      head = *u->cq_head;
+      if (head != atomic_load_explicit ((_Atomic unsigned *) u->cq_tail,
+					memory_order_acquire))
+	break;
+      sys_enter (u->fd, 0, 1, IORING_ENTER_GETEVENTS);
+    }
+  cqe = u->cqes + (head & *u->cq_mask);
+  *res = cqe->res;
+  i = (unsigned) cqe->user_data;
+  atomic_store_explicit ((_Atomic unsigned *) u->cq_head, head + 1,
+			 memory_order_release);
+  return i;
+}
+
+#else /* !USE_URING */
+
+URING *
+uring_create (char **bufs, unsigned nbufs, size_t size)
+{
+  return 0;
+}
+
+void
+uring_destroy (URING * u)
+{
+}
+
+int
+uring_start (URING * u, int fd, int write, unsigned i, size_t n,
+	     off_t off)
+{
+  return 1;
+}
+
+unsigned
+uring_wait (URING * u, long *res)
+{
+  *res = -1;
+  return 0;
+}
+
+#endif /* USE_URING */
+
+/* END OF FILE */
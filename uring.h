@@ -0,0 +1,64 @@
+/* uring.h -- asynchronous bulk file I/O for edlin
+
+  DESCRIPTION:
+
+  This file contains the interface to a minimal io_uring driver that
+  keeps several large reads or writes of whole buffers in flight at
+  once.  It talks to the kernel directly through the system calls, so
+  no extra library is needed.  On systems without io_uring, or when the
+  kernel refuses to set one up, uring_create() returns a null pointer
+  and the caller falls back to pread() and pwrite().
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+#ifndef URING_H
+#define URING_H
+
+#include <stddef.h>
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#endif
+
+/* typedefs */
+
+typedef struct URING URING;
+
+/* functions */
+
+/* set up a ring for up to nbufs requests at once, one per buffer.  The
+   buffers (each size bytes long) are registered with the kernel if it
+   lets us.  Returns a null pointer if io_uring cannot be used.  */
+URING *uring_create (char **bufs, unsigned nbufs, size_t size);
+
+/* tear a ring down; every request must have finished */
+void uring_destroy (URING * u);
+
+/* start reading (write == 0) or writing n bytes between buffer i and
+   the file fd at offset off.  Returns nonzero if the kernel would not
+   take the request, which is then forgotten; otherwise uring_wait must
+   be called for it, even if it fails.  */
+int uring_start (URING * u, int fd, int write, unsigned i, size_t n,
+		 off_t off);
+
+/* wait for a request to finish; returns the buffer it was for and puts
+   the byte count (or a negated errno value) in *res */
+unsigned uring_wait (URING * u, long *res);
+
+#endif
+
+/* END OF FILE */
@@ -0,0 +1,782 @@
+/* zio.c -- compressed files for edlin
+
+  DESCRIPTION:
+
+  This file contains edlin's compressed file streams.  A stream is read
+  a batch of blocks at a time for as long as the file is made up of
+  blocks that say how long they are: BGZF blocks (gzip members with a
+  "BC" extra field) or zstd frames behind pzstd's skippable size frames.
+  Each block in a batch is decompressed on its own in the worker pool.
+  Anything else is decompressed as one stream from there on.  Writing
+  always makes such blocks, compressed in parallel the same way.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+/* includes */
+
+#include "config.h"
+#include <ctype.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "defines.h"
+#include "pool.h"
+#include "zio.h"
+
+#if defined(HAVE_ZLIB_H) && defined(HAVE_LIBZ)
+#define USE_ZLIB
+#include <zlib.h>
+#endif
+#if defined(HAVE_ZSTD_H) && defined(HAVE_LIBZSTD)
+#define USE_ZSTD
+#include <zstd.h>
+#ifndef ZSTD_CLEVEL_DEFAULT
+#define ZSTD_CLEVEL_DEFAULT 3
+#endif
+#endif
+
+/* macros */
+
+/* How much data a block holds before it is compressed.  A BGZF block
+   has to fit in 64KiB once it is compressed.  */
+#define GZIP_BLOCK	((size_t) 65280)
+#if INT_MAX > 32767
+#define ZSTD_BLOCK	((size_t) 1 << 20)
+#else
+#define ZSTD_BLOCK	((size_t) 1 << 14)
+#endif
+
+/* The most blocks in a batch, and about the most data they may hold
+   between them.  */
+#define BATCH_BLOCKS	64
+#if INT_MAX > 32767
+#define BATCH_BYTES	((size_t) 1 << 23)
+#else
+#define BATCH_BYTES	((size_t) 1 << 16)
+#endif
+
+/* A block that says it holds more than this is not believed, and is
+   decompressed as part of a stream instead.  */
+#define BLOCK_MAX	(BATCH_BYTES * 4)
+
+/* How much compressed data is read at a time.  */
+#if INT_MAX > 32767
+#define IN_CHUNK	((size_t) 1 << 16)
+#else
+#define IN_CHUNK	((size_t) 1 << 12)
+#endif
+
+/* the gzip magic number, and pzstd's skippable frame */
+#define GZIP_MAGIC1	0x1f
+#define GZIP_MAGIC2	0x8b
+#define ZSTD_MAGIC	0xFD2FB528UL
+#define ZSTD_SKIP	0x184D2A50UL
+#define ZSTD_SKIP_MASK	0xFFFFFFF0UL
+
+/* A BGZF block is a gzip member with this header, followed by the
+   block size less one, and the empty block BGZF ends with.  */
+#define BGZF_HEADER	"\37\213\10\4\0\0\0\0\0\377\6\0BC\2\0"
+#define BGZF_HEADER_LEN	16
+#define BGZF_EXTRA	18	/* the header with its size field */
+#define BGZF_TRAILER	8	/* CRC-32 and length */
+#define BGZF_EOF	"\37\213\10\4\0\0\0\0\0\377\6\0BC\2\0\33\0\3\0\0\0\0\0\0\0\0\0"
+#define BGZF_EOF_LEN	28
+
+/* how much of a pzstd skippable frame goes before each frame */
+#define ZSTD_EXTRA	12
+
+/* typedefs */
+
+/* A block of a batch.  */
+typedef struct BLOCK
+{
+  size_t at;			/* where its compressed data starts in in */
+  size_t len;			/* how much compressed data there is */
+  char *data;			/* the data it holds */
+  size_t size;			/* how much of that there is */
+  size_t room;			/* how much data has room for */
+  char *packed;			/* when writing, the compressed block */
+  size_t packed_room;
+  int error;
+} BLOCK;
+
+struct ZIO
+{
+  FILE *f;
+  int format;
+  int write;
+  int level;
+  int error;
+  char *in;			/* compressed data read from f */
+  size_t in_pos;		/* how much of it has been used */
+  size_t in_len;		/* how much of it there is */
+  size_t in_room;
+  int eof;			/* has f run out? */
+  BLOCK block[BATCH_BLOCKS];
+  unsigned nblocks;		/* the blocks in the batch */
+  unsigned batch;		/* the most blocks in a batch */
+  size_t block_size;		/* when writing, how much goes in a block */
+  int packed_any;		/* has any block been written? */
+  unsigned next;		/* the block being read */
+  size_t pos;			/* how much of it has been read */
+  int streaming;		/* is the rest not in blocks? */
+  int started;			/* is the stream decompressor set up? */
+  int open;			/* is it in the middle of something? */
+  int done;			/* has everything been read? */
+#ifdef USE_ZLIB
+  z_stream zs;
+#endif
+#ifdef USE_ZSTD
+  ZSTD_DCtx *zd;
+#endif
+};
+
+/* functions */
+
+#if defined(USE_ZLIB) || defined(USE_ZSTD)
+
+/* get16, get32, put16, put32 - little-endian numbers */
+#ifdef USE_ZLIB
+static unsigned
+get16 (const char *s)
+{
+  const unsigned char *p = (const unsigned char *) s;
+
+  return p[0] | (unsigned) p[1] << 8;
+}
+#endif
+
+static unsigned long
+get32 (const char *s)
+{
+  const unsigned char *p = (const unsigned char *) s;
+
+  return p[0] | (unsigned long) p[1] << 8 | (unsigned long) p[2] << 16
+    | (unsigned long) p[3] << 24;
+}
+
+static void
+put16 (char *s, unsigned n)
+{
+  s[0] = (char) (n & 0xFF);
+  s[1] = (char) (n >> 8 & 0xFF);
+}
+
+static void
+put32 (char *s, unsigned long n)
+{
+  put16 (s, (unsigned) (n & 0xFFFF));
+  put16 (s + 2, (unsigned) (n >> 16 & 0xFFFF));
+}
+
+#endif
+
+/* xmalloc - malloc or die */
+static void *
+xmalloc (size_t n)
+{
+  void *p = malloc (n);
+
+  if (p == 0)
+    Nomemory ();
+  return p;
+}
+
+/* zio_detect - what format is the file f in? */
+int
+zio_detect (FILE * f)
+{
+  char m[4];
+  long at = ftell (f);
+  size_t n;
+
+  if (at < 0)
+    return ZIO_PLAIN;
+  n = fread (m, 1, sizeof m, f);
+  if (fseek (f, at, SEEK_SET) != 0)
+    return ZIO_PLAIN;
+#ifdef USE_ZLIB
+  if (n >= 2 && (unsigned char) m[0] == GZIP_MAGIC1
+      && (unsigned char) m[1] == GZIP_MAGIC2)
+    return ZIO_GZIP;
+#endif
+#ifdef USE_ZSTD
+  if (n == 4 && (get32 (m) == ZSTD_MAGIC
+		 || (get32 (m) & ZSTD_SKIP_MASK) == ZSTD_SKIP))
+    return ZIO_ZSTD;
+#endif
+  return ZIO_PLAIN;
+}
+
+/* zio_format_of_name - the format filename's extension asks for */
+int
+zio_format_of_name (char *filename)
+{
+  char *dot = strrchr (filename, '.');
+  char ext[5];
+  size_t i;
+
+  if (dot == 0 || strpbrk (dot, ":/\\") != 0 || strlen (dot) >= sizeof ext)
+    return ZIO_PLAIN;
+  for (i = 0; dot[i] != '\0'; ++i)
+    ext[i] = (char) tolower ((unsigned char) dot[i]);
+  ext[i] = '\0';
+#ifdef USE_ZLIB
+  if (strcmp (ext, ".gz") == 0)
+    return ZIO_GZIP;
+#endif
+#ifdef USE_ZSTD
+  if (strcmp (ext, ".zst") == 0)
+    return ZIO_ZSTD;
+#endif
+  return ZIO_PLAIN;
+}
+
+/* compression_level - the level ZIO_ENV asks for, within what the
+   library for format takes */
+static int
+compression_level (int format)
+{
+  char *s = getenv (ZIO_ENV), *e;
+  long level;
+
+  if (s == 0 || (level = strtol (s, &e, 10), e == s || *e != '\0'))
+    level = -1;
+  switch (format)
+    {
+#ifdef USE_ZLIB
+    case ZIO_GZIP:
+      return level < 0 ? Z_DEFAULT_COMPRESSION : level > 9 ? 9 : (int) level;
+#endif
+#ifdef USE_ZSTD
+    case ZIO_ZSTD:
+      return level < 1 ? ZSTD_CLEVEL_DEFAULT
+	: level > ZSTD_maxCLevel () ? ZSTD_maxCLevel () : (int) level;
+#endif
+    default:
+      return 0;
+    }
+}
+
+/* reading */
+
+/* discard - forget the compressed data that has been used */
+static void
+discard (ZIO * z)
+{
+  if (z->in_pos == 0)
+    return;
+  memmove (z->in, z->in + z->in_pos, z->in_len - z->in_pos);
+  z->in_len -= z->in_pos;
+  z->in_pos = 0;
+}
+
+/* have - make sure in holds the compressed data up to offset end,
+   reading more if need be; returns zero if the file ends first */
+static int
+have (ZIO * z, size_t end)
+{
+  size_t n;
+  char *p;
+
+  if (end > z->in_room)
+    {
+      n = z->in_room * 2 > end ? z->in_room * 2 : end + IN_CHUNK;
+      if ((p = realloc (z->in, n)) == 0)
+	Nomemory ();
+      z->in = p;
+      z->in_room = n;
+    }
+  while (z->in_len < end && !z->eof)
+    {
+      n = fread (z->in + z->in_len, 1, z->in_room - z->in_len, z->f);
+      if (n == 0)
+	{
+	  z->eof = 1;
+	  if (ferror (z->f))
+	    z->error = 1;
+	}
+      z->in_len += n;
+    }
+  return z->in_len >= end;
+}
+
+/* block_at - if a block that says how long it is starts at offset at of
+   in, fill in b and return how much of the input it takes up */
+static size_t
+block_at (ZIO * z, size_t at, BLOCK * b)
+{
+  size_t i, xlen, len = 0;
+
+  switch (z->format)
+    {
+#ifdef USE_ZLIB
+    case ZIO_GZIP:
+      /* a gzip member with an extra field holding a BC subfield */
+      if (!have (z, at + 12)
+	  || (unsigned char) z->in[at] != GZIP_MAGIC1
+	  || (unsigned char) z->in[at + 1] != GZIP_MAGIC2
+	  || z->in[at + 2] != 8 || (z->in[at + 3] & 4) == 0)
+	return 0;
+      xlen = get16 (z->in + at + 10);
+      if (!have (z, at + 12 + xlen))
+	return 0;
+      for (i = 12; i + 4 <= 12 + xlen; i += 4 + get16 (z->in + at + i + 2))
+	if (z->in[at + i] == 'B' && z->in[at + i + 1] == 'C'
+	    && get16 (z->in + at + i + 2) == 2 && i + 6 <= 12 + xlen)
+	  {
+	    len = get16 (z->in + at + i + 4) + (size_t) 1;
+	    break;
+	  }
+      if (len < 12 + xlen + BGZF_TRAILER || !have (z, at + len))
+	return 0;
+      b->at = at;
+      b->len = len;
+      b->size = get32 (z->in + at + len - 4);
+      if (b->size > BLOCK_MAX)
+	return 0;
+      return len;
+#endif
+#ifdef USE_ZSTD
+    case ZIO_ZSTD:
+      {
+	unsigned long long size;
+
+	/* a skippable frame holding the size of the frame after it */
+	if (!have (z, at + ZSTD_EXTRA) || get32 (z->in + at) != ZSTD_SKIP
+	    || get32 (z->in + at + 4) != 4
+	    || (len = get32 (z->in + at + 8)) > BLOCK_MAX
+	    || !have (z, at + ZSTD_EXTRA + len))
+	  return 0;
+	size = ZSTD_getFrameContentSize (z->in + at + ZSTD_EXTRA, len);
+	if (size == ZSTD_CONTENTSIZE_UNKNOWN || size == ZSTD_CONTENTSIZE_ERROR
+	    || size > BLOCK_MAX)
+	  return 0;
+	b->at = at + ZSTD_EXTRA;
+	b->len = len;
+	b->size = (size_t) size;
+	return ZSTD_EXTRA + len;
+      }
+#endif
+    default:
+      return 0;
+    }
+}
+
+/* unpack_blocks - decompress blocks first up to last of the batch */
+static void
+unpack_blocks (void *arg, unsigned long first, unsigned long last)
+{
+  ZIO *z = arg;
+  BLOCK *b;
+
+  for (; first < last; ++first)
+    {
+      b = z->block + first;
+      b->error = 1;
+      switch (z->format)
+	{
+#ifdef USE_ZLIB
+	case ZIO_GZIP:
+	  {
+	    z_stream s;
+
+	    memset (&s, 0, sizeof s);
+	    if (inflateInit2 (&s, 15 + 16) != Z_OK)
+	      break;
+	    s.next_in = (Bytef *) z->in + b->at;
+	    s.avail_in = (uInt) b->len;
+	    s.next_out = (Bytef *) b->data;
+	    s.avail_out = (uInt) b->room;
+	    b->error = inflate (&s, Z_FINISH) != Z_STREAM_END
+	      || s.total_out != b->size;
+	    inflateEnd (&s);
+	    break;
+	  }
+#endif
+#ifdef USE_ZSTD
+	case ZIO_ZSTD:
+	  {
+	    size_t n = ZSTD_decompress (b->data, b->room, z->in + b->at,
+					b->len);
+
+	    b->error = ZSTD_isError (n) || n != b->size;
+	    break;
+	  }
+#endif
+	default:
+	  break;
+	}
+    }
+}
+
+/* next_batch - read and decompress the next batch of blocks; returns
+   zero if the input does not go on in blocks */
+static int
+next_batch (ZIO * z)
+{
+  size_t at = 0, n, total = 0;
+  unsigned i;
+  BLOCK *b;
+
+  discard (z);
+  z->nblocks = z->next = 0;
+  z->pos = 0;
+  while (z->nblocks < BATCH_BLOCKS && total < BATCH_BYTES
+	 && (n = block_at (z, at, b = z->block + z->nblocks)) != 0)
+    {
+      if (b->room < b->size + 1)
+	{
+	  free (b->data);
+	  b->room = b->size + 1;
+	  b->data = xmalloc (b->room);
+	}
+      total += b->size;
+      at += n;
+      z->nblocks++;
+    }
+  pool_for_range (0, z->nblocks, 1, unpack_blocks, z);
+  z->in_pos = at;
+  for (i = 0; i < z->nblocks; ++i)
+    if (z->block[i].error)
+      z->error = 1;
+  return z->nblocks != 0;
+}
+
+/* stream - decompress what is left, which is not in blocks, straight
+   into s; returns how much was put there */
+static size_t
+stream (ZIO * z, char *s, size_t n)
+{
+  size_t got = 0;
+
+  while (got < n && !z->error && !z->done)
+    {
+      if (z->in_pos == z->in_len)
+	{
+	  discard (z);
+	  if (!have (z, 1))
+	    {
+	      /* a stream that stops short is an error */
+	      if (z->open)
+		z->error = 1;
+	      z->done = 1;
+	      break;
+	    }
+	}
+      switch (z->format)
+	{
+#ifdef USE_ZLIB
+	case ZIO_GZIP:
+	  {
+	    int r;
+
+	    if (!z->open)
+	      {
+		/* another member, or junk that gzip would ignore too */
+		if (!have (z, z->in_pos + 2)
+		    || (unsigned char) z->in[z->in_pos] != GZIP_MAGIC1
+		    || (unsigned char) z->in[z->in_pos + 1] != GZIP_MAGIC2)
+		  {
+		    z->done = 1;
+		    break;
+		  }
+		if ((z->started ? inflateReset (&z->zs)
+		     : inflateInit2 (&z->zs, 15 + 16)) != Z_OK)
+		  {
+		    z->error = 1;
+		    break;
+		  }
+		z->started = z->open = 1;
+	      }
+	    z->zs.next_in = (Bytef *) z->in + z->in_pos;
+	    z->zs.avail_in = (uInt) (z->in_len - z->in_pos > UINT_MAX
+				     ? UINT_MAX : z->in_len - z->in_pos);
+	    z->zs.next_out = (Bytef *) s + got;
+	    z->zs.avail_out = (uInt) (n - got > UINT_MAX ? UINT_MAX : n - got);
+	    r = inflate (&z->zs, Z_NO_FLUSH);
+	    z->in_pos = (char *) z->zs.next_in - z->in;
+	    got = (char *) z->zs.next_out - s;
+	    if (r == Z_STREAM_END)
+	      z->open = 0;
+	    else if (r != Z_OK && r != Z_BUF_ERROR)
+	      z->error = 1;
+	    break;
+	  }
+#endif
+#ifdef USE_ZSTD
+	case ZIO_ZSTD:
+	  {
+	    ZSTD_inBuffer in;
+	    ZSTD_outBuffer out;
+	    size_t r;
+
+	    if (z->zd == 0 && (z->zd = ZSTD_createDCtx ()) == 0)
+	      Nomemory ();
+	    in.src = z->in + z->in_pos;
+	    in.size = z->in_len - z->in_pos;
+	    in.pos = 0;
+	    out.dst = s;
+	    out.size = n;
+	    out.pos = got;
+	    r = ZSTD_decompressStream (z->zd, &out, &in);
+	    z->in_pos += in.pos;
+	    got = out.pos;
+	    if (ZSTD_isError (r))
+	      z->error = 1;
+	    else
+	      z->open = r != 0;
+	    break;
+	  }
+#endif
+	default:
+	  z->error = 1;
+	  break;
+	}
+    }
+  return got;
+}
+
+/* zio_read - read up to n bytes of decompressed data into s */
+size_t
+zio_read (ZIO * z, char *s, size_t n)
+{
+  size_t got = 0, m;
+  BLOCK *b;
+
+  while (got < n && !z->error && !z->done)
+    {
+      if (z->next < z->nblocks)
+	{
+	  b = z->block + z->next;
+	  m = b->size - z->pos;
+	  if (m > n - got)
+	    m = n - got;
+	  memcpy (s + got, b->data + z->pos, m);
+	  got += m;
+	  z->pos += m;
+	  if (z->pos == b->size)
+	    {
+	      z->next++;
+	      z->pos = 0;
+	    }
+	}
+      else if (z->streaming)
+	got += stream (z, s + got, n - got);
+      else if (!next_batch (z))
+	z->streaming = 1;
+    }
+  return got;
+}
+
+/* writing */
+
+/* pack_blocks - compress blocks first up to last of the batch */
+static void
+pack_blocks (void *arg, unsigned long first, unsigned long last)
+{
+  ZIO *z = arg;
+  BLOCK *b;
+
+  for (; first < last; ++first)
+    {
+      b = z->block + first;
+      b->error = 1;
+      switch (z->format)
+	{
+#ifdef USE_ZLIB
+	case ZIO_GZIP:
+	  {
+	    z_stream s;
+	    unsigned long crc;
+
+	    memset (&s, 0, sizeof s);
+	    if (deflateInit2 (&s, z->level, Z_DEFLATED, -15, 8,
+			      Z_DEFAULT_STRATEGY) != Z_OK)
+	      break;
+	    s.next_in = (Bytef *) b->data;
+	    s.avail_in = (uInt) b->size;
+	    s.next_out = (Bytef *) b->packed + BGZF_EXTRA;
+	    s.avail_out = (uInt) (b->packed_room - BGZF_EXTRA - BGZF_TRAILER);
+	    b->error = deflate (&s, Z_FINISH) != Z_STREAM_END;
+	    b->len = BGZF_EXTRA + s.total_out + BGZF_TRAILER;
+	    deflateEnd (&s);
+	    memcpy (b->packed, BGZF_HEADER, BGZF_HEADER_LEN);
+	    put16 (b->packed + BGZF_HEADER_LEN, (unsigned) (b->len - 1));
+	    crc = crc32 (crc32 (0L, Z_NULL, 0), (Bytef *) b->data,
+			 (uInt) b->size);
+	    put32 (b->packed + b->len - 8, crc);
+	    put32 (b->packed + b->len - 4, (unsigned long) b->size);
+	    break;
+	  }
+#endif
+#ifdef USE_ZSTD
+	case ZIO_ZSTD:
+	  {
+	    size_t n = ZSTD_compress (b->packed + ZSTD_EXTRA,
+				      b->packed_room - ZSTD_EXTRA, b->data,
+				      b->size, z->level);
+
+	    if (ZSTD_isError (n))
+	      break;
+	    put32 (b->packed, ZSTD_SKIP);
+	    put32 (b->packed + 4, 4);
+	    put32 (b->packed + 8, (unsigned long) n);
+	    b->len = ZSTD_EXTRA + n;
+	    b->error = 0;
+	    break;
+	  }
+#endif
+	default:
+	  break;
+	}
+    }
+}
+
+/* flush_batch - compress the blocks of the batch and write them out */
+static void
+flush_batch (ZIO * z)
+{
+  unsigned i;
+  BLOCK *b;
+
+  pool_for_range (0, z->nblocks, 1, pack_blocks, z);
+  for (i = 0; i < z->nblocks; ++i)
+    {
+      b = z->block + i;
+      if (b->error || fwrite (b->packed, 1, b->len, z->f) != b->len)
+	z->error = 1;
+      b->size = 0;
+    }
+  if (z->nblocks != 0)
+    z->packed_any = 1;
+  z->nblocks = 0;
+}
+
+/* zio_write - compress n bytes from s onto the stream */
+void
+zio_write (ZIO * z, const char *s, size_t n)
+{
+  size_t m;
+  BLOCK *b;
+
+  while (n != 0)
+    {
+      b = z->block + z->nblocks;
+      m = z->block_size - b->size;
+      if (m > n)
+	m = n;
+      memcpy (b->data + b->size, s, m);
+      b->size += m;
+      s += m;
+      n -= m;
+      if (b->size == z->block_size && ++z->nblocks == z->batch)
+	flush_batch (z);
+    }
+}
+
+/* zio_open - start reading or writing a compressed stream */
+ZIO *
+zio_open (FILE * f, int format, int write)
+{
+  ZIO *z = xmalloc (sizeof (ZIO));
+  size_t room = 0;
+  unsigned i;
+
+  memset (z, 0, sizeof (ZIO));
+  z->f = f;
+  z->format = format;
+  z->write = write;
+  if (!write)
+    return z;
+  z->level = compression_level (format);
+  switch (format)
+    {
+#ifdef USE_ZLIB
+    case ZIO_GZIP:
+      z->block_size = GZIP_BLOCK;
+      room = compressBound ((uLong) GZIP_BLOCK) + BGZF_EXTRA + BGZF_TRAILER;
+      break;
+#endif
+#ifdef USE_ZSTD
+    case ZIO_ZSTD:
+      z->block_size = ZSTD_BLOCK;
+      room = ZSTD_compressBound (ZSTD_BLOCK) + ZSTD_EXTRA;
+      break;
+#endif
+    default:
+      z->block_size = GZIP_BLOCK;
+      z->error = 1;
+      break;
+    }
+  z->batch = (unsigned) (BATCH_BYTES / z->block_size);
+  if (z->batch > BATCH_BLOCKS)
+    z->batch = BATCH_BLOCKS;
+  if (z->batch == 0)
+    z->batch = 1;
+  for (i = 0; i < z->batch; ++i)
+    {
+      z->block[i].data = xmalloc (z->block_size);
+      z->block[i].packed = xmalloc (room == 0 ? 1 : room);
+      z->block[i].packed_room = room;
+    }
+  return z;
+}
+
+/* zio_close - finish the stream */
+int
+zio_close (ZIO * z)
+{
+  int error;
+  unsigned i;
+
+  if (z->write)
+    {
+      /* the last block may not be full, and even an empty stream has a
+	 block */
+      if (z->nblocks < z->batch
+	  && (z->block[z->nblocks].size != 0 || !z->packed_any))
+	z->nblocks++;
+      flush_batch (z);
+      if (z->format == ZIO_GZIP
+	  && fwrite (BGZF_EOF, 1, BGZF_EOF_LEN, z->f) != BGZF_EOF_LEN)
+	z->error = 1;
+      if (fflush (z->f) != 0)
+	z->error = 1;
+    }
+#ifdef USE_ZLIB
+  if (z->started)
+    inflateEnd (&z->zs);
+#endif
+#ifdef USE_ZSTD
+  if (z->zd != 0)
+    ZSTD_freeDCtx (z->zd);
+#endif
+  for (i = 0; i < BATCH_BLOCKS; ++i)
+    {
+      free (z->block[i].data);
+      free (z->block[i].packed);
+    }
+  free (z->in);
+  error = z->error;
+  free (z);
+  return error;
+}
+
+/* END OF FILE */
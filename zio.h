@@ -0,0 +1,79 @@
+/* zio.h -- compressed files for edlin
+
+  DESCRIPTION:
+
+  This file contains the interface to edlin's compressed file streams.
+  Files compressed with gzip (through zlib) or zstd (through libzstd),
+  where those libraries were found when edlin was built, are recognized
+  by their first bytes and decompressed as they are read.  Files made up
+  of independent blocks that record their own sizes (BGZF for gzip, and
+  pzstd's framing for zstd) are decompressed a batch of blocks at a
+  time, spread across the worker pool, and edlin writes compressed
+  files in those forms so that the next load can do the same.
+
+  COPYRIGHT NOTICE AND DISCLAIMER:
+
+  This program is free software; you can redistribute it and/or
+  modify it under the terms of the GNU General Public License
+  as published by the Free Software Foundation; either version 2
+  of the License, or (at your option) any later version.
+
+  This program is distributed in the hope that it will be useful,
+  but WITHOUT ANY WARRANTY; without even the implied warranty of
+  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+  GNU General Public License for more details.
+
+  You should have received a copy of the GNU General Public License along
+  with this program; if not, write to the Free Software Foundation, Inc.,
+  51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA.
+*/
+
+#ifndef ZIO_H
+#define ZIO_H
+
+#include <stdio.h>
+
+/* macros */
+
+/* the formats */
+#define ZIO_PLAIN       0       /* not compressed */
+#define ZIO_GZIP        1
+#define ZIO_ZSTD        2
+
+/* The environment variable that sets the compression level of saves;
+   without it, each library's own default is used.  */
+#define ZIO_ENV         "EDLIN_LEVEL"
+
+/* typedefs */
+
+typedef struct ZIO ZIO;
+
+/* functions */
+
+/* look at the first bytes of f, which must be at the start of a file
+   that can be seeked on, and put it back where it was; returns the
+   format the file is in, or ZIO_PLAIN if it is not compressed in a way
+   this edlin can read */
+int zio_detect (FILE * f);
+
+/* the format a new file called filename should be written in */
+int zio_format_of_name (char *filename);
+
+/* start reading (write == 0) or writing a stream of the given format
+   through f */
+ZIO *zio_open (FILE * f, int format, int write);
+
+/* read up to n bytes of decompressed data into s; like fread, returns
+   less than n only at the end of the data or on an error */
+size_t zio_read (ZIO * z, char *s, size_t n);
+
+/* compress n bytes from s onto the stream */
+void zio_write (ZIO * z, const char *s, size_t n);
+
+/* finish the stream; returns nonzero if there was an error.  The file
+   itself is left open.  */
+int zio_close (ZIO * z);
+
+#endif
+
+/* END OF FILE */